@@ -0,0 +1,270 @@
+#include "asset_loader.hpp"
+#include "gl_state.hpp"
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+#include <lodepng.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+AssetLoader::AssetLoader()
+{
+    // Mid grey, close to the average of the ship's textures
+    const unsigned char grey[4] = {128, 128, 128, 255};
+    glGenTextures(1, &placeholder);
+    gl_state().bind_texture(0, placeholder);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+#if texture_upload_pbo
+    glGenBuffers(1, &pixel_buffer);
+#endif
+}
+
+AssetLoader::~AssetLoader()
+{
+    job_system().wait(jobs);
+
+    for (Upload &upload : uploads)
+        delete upload.mesh;
+    for (auto &entry : textures)
+    {
+        TextureRequest *texture = entry.second;
+        if (texture->ready)
+            texture_cache().release(texture->texture);
+        else
+            // Only partially uploaded, not in the cache yet
+            gl_state().delete_textures(1, &texture->texture);
+        delete texture;
+    }
+    for (SceneRequest *scene : scenes)
+        delete scene;
+    gl_state().delete_buffers(1, &pixel_buffer);
+    gl_state().delete_textures(1, &placeholder);
+}
+
+void AssetLoader::load_scene(const char *path, std::vector<Mesh *> &meshes)
+{
+    SceneRequest *scene = new SceneRequest{this, path, &meshes};
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        scenes.push_back(scene);
+        if (!loading)
+            load_start = std::chrono::steady_clock::now();
+        loading = true;
+    }
+    jobs.pending.fetch_add(1, std::memory_order_relaxed);
+    job_system().run_background(Job{import_scene, scene, 0, 1, &jobs});
+}
+
+void AssetLoader::import_scene(void *data, size_t, size_t)
+{
+    SceneRequest &request = *(SceneRequest *)data;
+    AssetLoader &loader = *request.loader;
+
+    Assimp::Importer importer;
+    const aiScene *scene = importer.ReadFile(request.path, aiProcess_Triangulate | aiProcess_FlipUVs);
+    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+    {
+        std::cout << "ERROR::ASSIMP::" << importer.GetErrorString() << std::endl;
+        return;
+    }
+
+    std::vector<Mesh *> loaded(scene->mNumMeshes);
+    job_system().parallel_for(loaded.size(), 1, [&](size_t begin, size_t end)
+                              {
+        for (size_t i = begin; i < end; ++i)
+            loaded[i] = new Mesh(scene->mMeshes[i], scene); });
+
+    // Decoding starts before optimizing so both run side by side
+    for (Mesh *mesh : loaded)
+    {
+        loader.request_texture(mesh->diffuse_path);
+        loader.request_texture(mesh->roughness_path);
+    }
+
+    job_system().parallel_for(loaded.size(), 1, [&](size_t begin, size_t end)
+                              {
+        for (size_t i = begin; i < end; ++i)
+        {
+            Mesh *mesh = loaded[i];
+            mesh->optimize();
+            std::vector<PackedVertex> vertices = pack_vertices(mesh->vertex_positons, mesh->vertex_normals,
+                                                               mesh->has_texture_coordinates ? mesh->texture_coordinates : std::vector<glm::vec2>());
+            loader.push_upload(Upload{mesh, std::move(vertices), request.meshes, nullptr});
+        } });
+}
+
+void AssetLoader::request_texture(const std::string &path)
+{
+    if (path.empty())
+        return;
+
+    TextureRequest *texture;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (textures.count(path))
+            return;
+        texture = new TextureRequest();
+        texture->loader = this;
+        texture->path = path;
+        textures[path] = texture;
+    }
+    jobs.pending.fetch_add(1, std::memory_order_relaxed);
+    job_system().run_background(Job{decode_texture, texture, 0, 1, &jobs});
+}
+
+void AssetLoader::decode_texture(void *data, size_t, size_t)
+{
+    TextureRequest &texture = *(TextureRequest *)data;
+    if (unsigned error = lodepng::decode(texture.chain.pixels, texture.chain.width, texture.chain.height, texture.path))
+    {
+        std::cout << "LODEPNG ERROR " << error << " " << texture.path << std::endl;
+        texture.chain.pixels.clear();
+    }
+    else
+        build_mip_chain(texture.chain);
+    // Failed textures are queued as well, their users keep the placeholder
+    texture.loader->push_upload(Upload{nullptr, {}, nullptr, &texture});
+}
+
+void AssetLoader::push_upload(Upload &&upload)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    uploads.push_back(std::move(upload));
+}
+
+void AssetLoader::attach_texture(const std::string &path, GLuint *slot)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = textures.find(path);
+    if (found == textures.end())
+        return;
+
+    TextureRequest &texture = *found->second;
+    if (texture.ready && texture.texture)
+    {
+        *slot = texture.texture;
+        texture_cache().retain(texture.texture);
+        return;
+    }
+    *slot = placeholder;
+    if (!texture.ready)
+        texture.users.push_back(slot);
+}
+
+bool AssetLoader::upload_texture_rows(TextureRequest &texture)
+{
+    MipChain &chain = texture.chain;
+    if (!texture.texture && !chain.pixels.empty())
+    {
+        // Another scene or a pack may have brought the same file
+        texture.texture = texture_cache().find(texture.path);
+        if (texture.texture)
+            std::vector<unsigned char>().swap(chain.pixels);
+        else
+            // Storage first, levels follow in bands of rows
+            texture.texture = TextureCache::create_storage(chain.width, chain.height, chain.levels, TextureSampler());
+    }
+
+    if (!chain.pixels.empty())
+    {
+        gl_state().bind_texture(0, texture.texture);
+
+        unsigned width = chain.level_width(texture.level), height = chain.level_height(texture.level);
+        unsigned rows = std::min((unsigned)texture_upload_rows, height - texture.uploaded_rows);
+        size_t row_size = (size_t)width * 4;
+        const unsigned char *band = chain.pixels.data() + chain.level_offset(texture.level) + texture.uploaded_rows * row_size;
+#if texture_upload_pbo
+        // Orphaning gives a fresh buffer each band, the previous one may still be read by the driver
+        gl_state().bind_buffer(GL_PIXEL_UNPACK_BUFFER, pixel_buffer);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, rows * row_size, nullptr, GL_STREAM_DRAW);
+        void *staging = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, rows * row_size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        memcpy(staging, band, rows * row_size);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glTexSubImage2D(GL_TEXTURE_2D, texture.level, 0, texture.uploaded_rows, width, rows, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        // Uploads from client memory elsewhere need the unpack buffer unbound
+        gl_state().bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+#else
+        glTexSubImage2D(GL_TEXTURE_2D, texture.level, 0, texture.uploaded_rows, width, rows, GL_RGBA, GL_UNSIGNED_BYTE, band);
+#endif
+        texture.uploaded_rows += rows;
+        if (texture.uploaded_rows == height)
+        {
+            texture.uploaded_rows = 0;
+            ++texture.level;
+        }
+        if (texture.level < chain.levels)
+            return false;
+
+        texture_cache().adopt(texture.path, TextureSampler(), texture.texture, mip_chain_size(chain.width, chain.height, chain.levels));
+        std::vector<unsigned char>().swap(chain.pixels);
+    }
+
+    // Failed textures end up here with texture 0, their users keep the placeholder
+    std::lock_guard<std::mutex> lock(mutex);
+    texture.ready = true;
+    if (texture.texture)
+        for (GLuint *slot : texture.users)
+        {
+            *slot = texture.texture;
+            texture_cache().retain(texture.texture);
+        }
+    texture.users.clear();
+    return true;
+}
+
+void AssetLoader::process_uploads(double budget_ms)
+{
+    auto start = std::chrono::steady_clock::now();
+    while (true)
+    {
+        Upload upload;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (uploads.empty())
+                break;
+            upload = std::move(uploads.front());
+            uploads.pop_front();
+        }
+
+        if (upload.mesh)
+        {
+            Mesh *mesh = upload.mesh;
+            mesh->upload_buffers(upload.vertices.data(), upload.vertices.size(), (const uint32_t *)mesh->faces.data(), mesh->faces.size() * 3);
+            attach_texture(mesh->diffuse_path, &mesh->diffuse_texture);
+            attach_texture(mesh->roughness_path, &mesh->roughness_texture);
+            upload.meshes->push_back(mesh);
+        }
+        else if (!upload_texture_rows(*upload.texture))
+        {
+            // Finish one texture before starting the next, only one decoded image waits in memory
+            std::lock_guard<std::mutex> lock(mutex);
+            uploads.push_front(std::move(upload));
+        }
+
+        if (std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() >= budget_ms)
+            break;
+    }
+
+    if (is_idle())
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (loading)
+        {
+            std::cout << "Assets loaded in " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - load_start).count()
+                      << " ms on " << job_system().get_thread_count() << " threads" << std::endl;
+            texture_cache().print_resident();
+            loading = false;
+        }
+    }
+}
+
+bool AssetLoader::is_idle()
+{
+    if (jobs.pending.load(std::memory_order_acquire) > 0)
+        return false;
+    std::lock_guard<std::mutex> lock(mutex);
+    return uploads.empty();
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <GL/glew.h>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "mesh.h"
+#include "job_system.hpp"
+#include "texture_cache.hpp"
+
+// GL thread time spent on uploads of loaded assets per frame
+#define asset_upload_budget_ms 2.0
+// Texture rows uploaded per step, big textures are spread over several frames
+#define texture_upload_rows 256
+// Stage texture rows through a pixel buffer object so the driver can copy them asynchronously
+#define texture_upload_pbo 1
+
+/// Loads scenes in the background. Import, mesh optimization and image decoding run on the job system,
+/// the GL thread only uploads finished data from process_uploads, a bounded amount per frame.
+/// Meshes show up once their buffers are uploaded, textures that are still loading are drawn with a placeholder
+/// and swapped in when ready. Textures go to texture_cache(), every mesh slot holds a reference.
+class AssetLoader
+{
+public:
+    /// Creates the placeholder, GL thread only
+    AssetLoader();
+    /// Waits for running jobs and drops its own texture references, meshes already handed out stay with their owner
+    ~AssetLoader();
+    AssetLoader(const AssetLoader &) = delete;
+    AssetLoader &operator=(const AssetLoader &) = delete;
+
+    /// Starts importing path, its meshes are appended to meshes by process_uploads
+    void load_scene(const char *path, std::vector<Mesh *> &meshes);
+    /// Runs queued uploads for at most budget_ms, or a single step if that takes longer. GL thread only.
+    void process_uploads(double budget_ms = asset_upload_budget_ms);
+    /// True when nothing is loading or waiting for upload
+    bool is_idle();
+
+    GLuint get_placeholder() const { return placeholder; }
+
+private:
+    struct TextureRequest
+    {
+        AssetLoader *loader;
+        std::string path;
+        MipChain chain; // Decoded and filtered on a worker, freed after upload
+        unsigned level = 0, uploaded_rows = 0;
+        GLuint texture = 0; // 0 until upload starts, stays 0 if decoding failed. One cache reference is the loader's.
+        bool ready = false;
+        std::vector<GLuint *> users; // Mesh texture slots showing the placeholder until ready
+    };
+
+    struct SceneRequest
+    {
+        AssetLoader *loader;
+        std::string path;
+        std::vector<Mesh *> *meshes;
+    };
+
+    /// A mesh ready for its buffers, or a texture with rows left to upload
+    struct Upload
+    {
+        Mesh *mesh;
+        std::vector<PackedVertex> vertices;
+        std::vector<Mesh *> *meshes;
+        TextureRequest *texture;
+    };
+
+    GLuint placeholder = 0;
+    GLuint pixel_buffer = 0;
+    JobCounter jobs;
+
+    std::mutex mutex; // Guards everything below
+    std::deque<SceneRequest *> scenes;
+    std::map<std::string, TextureRequest *> textures;
+    std::deque<Upload> uploads;
+    std::chrono::steady_clock::time_point load_start;
+    bool loading = false;
+
+    static void import_scene(void *data, size_t begin, size_t end);
+    static void decode_texture(void *data, size_t begin, size_t end);
+    void request_texture(const std::string &path);
+    void attach_texture(const std::string &path, GLuint *slot);
+    /// Uploads the next band of rows, true once the texture is complete
+    bool upload_texture_rows(TextureRequest &texture);
+    void push_upload(Upload &&upload);
+};
@@ -0,0 +1,189 @@
+#include "asset_pack.hpp"
+#include "mesh_optimizer.hpp"
+#include "mip_chain.hpp"
+#include "texture_compression.hpp"
+#include <cstdio>
+#include <cstring>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+bool stat_source(const char *path, int64_t &modification_time, uint64_t &size)
+{
+    struct stat info;
+    if (stat(path, &info) != 0)
+        return false;
+    modification_time = info.st_mtime;
+    size = info.st_size;
+    return true;
+}
+
+AssetPack::~AssetPack()
+{
+    close();
+}
+
+void AssetPack::close()
+{
+    if (!memory)
+        return;
+#ifdef _WIN32
+    UnmapViewOfFile(memory);
+    CloseHandle(mapping);
+    CloseHandle(file);
+#else
+    munmap((void *)memory, size);
+#endif
+    memory = nullptr;
+    size = 0;
+}
+
+bool AssetPack::open(const char *path)
+{
+    close();
+
+#ifdef _WIN32
+    file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        printf("Asset pack %s: can't open\n", path);
+        return false;
+    }
+    LARGE_INTEGER file_size;
+    GetFileSizeEx(file, &file_size);
+    size = file_size.QuadPart;
+    mapping = size >= sizeof(PackHeader) ? CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+    memory = mapping ? (const unsigned char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!memory)
+    {
+        if (mapping)
+            CloseHandle(mapping);
+        CloseHandle(file);
+        size = 0;
+        printf("Asset pack %s: can't map\n", path);
+        return false;
+    }
+#else
+    int descriptor = ::open(path, O_RDONLY);
+    if (descriptor < 0)
+    {
+        printf("Asset pack %s: can't open\n", path);
+        return false;
+    }
+    struct stat info;
+    fstat(descriptor, &info);
+    size = info.st_size;
+    void *mapped = size >= sizeof(PackHeader) ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0) : MAP_FAILED;
+    // The mapping stays valid without the descriptor
+    ::close(descriptor);
+    if (mapped == MAP_FAILED)
+    {
+        size = 0;
+        printf("Asset pack %s: can't map\n", path);
+        return false;
+    }
+    memory = (const unsigned char *)mapped;
+#endif
+
+    const PackHeader &h = header();
+    if (h.magic != asset_pack_magic || h.version != asset_pack_version || h.file_size != size)
+    {
+        printf("Asset pack %s: version %u, expected %u, or truncated\n", path, h.version, asset_pack_version);
+        close();
+        return false;
+    }
+    if (!validate(path))
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool AssetPack::fits(uint64_t offset, uint64_t count, size_t element_size) const
+{
+    // Divided rather than multiplied, a corrupt count must not overflow
+    return offset <= size && count <= (size - offset) / element_size;
+}
+
+// Fixed size strings of the pack are used as C strings
+template <size_t N>
+static bool is_terminated(const char (&text)[N])
+{
+    return memchr(text, 0, N) != nullptr;
+}
+
+bool AssetPack::validate(const char *path) const
+{
+    const PackHeader &h = header();
+    if (!fits(h.sources_offset, h.source_count, sizeof(PackSource)) ||
+        !fits(h.meshes_offset, h.mesh_count, sizeof(PackMesh)) ||
+        !fits(h.textures_offset, h.texture_count, sizeof(PackTexture)))
+    {
+        printf("Asset pack %s: tables outside the file\n", path);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < h.source_count; ++i)
+        if (!is_terminated(source(i).path))
+        {
+            printf("Asset pack %s: source %u has no valid path\n", path, i);
+            return false;
+        }
+
+    for (uint32_t i = 0; i < h.texture_count; ++i)
+    {
+        const PackTexture &entry = texture(i);
+        // Bounded dimensions and level count first, texture_chain_size could overflow otherwise
+        if (!is_terminated(entry.path) || entry.format > TEXTURE_BC4 || entry.width == 0 || entry.height == 0 ||
+            entry.width > asset_pack_max_texture_size || entry.height > asset_pack_max_texture_size ||
+            entry.levels == 0 || entry.levels > full_mip_levels(entry.width, entry.height) ||
+            !fits(entry.offset, texture_chain_size((TextureFormat)entry.format, entry.width, entry.height, entry.levels), 1))
+        {
+            printf("Asset pack %s: texture %u is corrupt\n", path, i);
+            return false;
+        }
+    }
+
+    for (uint32_t i = 0; i < h.mesh_count; ++i)
+    {
+        const PackMesh &entry = mesh(i);
+        bool valid = is_terminated(entry.name) && entry.index_count % 3 == 0 &&
+                     fits(entry.vertices_offset, entry.vertex_count, sizeof(PackedVertex)) &&
+                     fits(entry.indices_offset, entry.index_count, sizeof(uint32_t)) &&
+                     entry.diffuse_texture >= -1 && entry.diffuse_texture < (int64_t)h.texture_count &&
+                     entry.roughness_texture >= -1 && entry.roughness_texture < (int64_t)h.texture_count;
+        // Indices past the vertices would make the GPU read outside the vertex buffer
+        const uint32_t *indices = valid ? (const uint32_t *)at(entry.indices_offset) : nullptr;
+        for (uint32_t j = 0; valid && j < entry.index_count; ++j)
+            valid = indices[j] < entry.vertex_count;
+        if (!valid)
+        {
+            printf("Asset pack %s: mesh %u is corrupt\n", path, i);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool AssetPack::is_stale() const
+{
+    for (uint32_t i = 0; i < header().source_count; ++i)
+    {
+        int64_t modification_time;
+        uint64_t size;
+        const PackSource &recorded = source(i);
+        if (stat_source(recorded.path, modification_time, size) &&
+            (modification_time != recorded.modification_time || size != recorded.size))
+        {
+            printf("Asset pack: %s changed since baking\n", recorded.path);
+            return true;
+        }
+    }
+    return false;
+}
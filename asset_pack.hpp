@@ -0,0 +1,84 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Baked scene layout, see bake.cpp. Bump the version whenever a struct below changes.
+#define asset_pack_magic 0x4b504153u // "SAPK"
+#define asset_pack_version 2
+// Every section starts at a multiple of this
+#define asset_pack_alignment 16
+// Largest texture width or height a pack may hold, bigger ones are rejected as corrupt
+#define asset_pack_max_texture_size 16384
+
+struct PackHeader
+{
+    uint32_t magic, version;
+    uint64_t file_size;
+    uint32_t source_count, mesh_count, texture_count, reserved;
+    uint64_t sources_offset, meshes_offset, textures_offset; // PackSource, PackMesh and PackTexture tables
+};
+
+/// A file the pack was baked from, the pack is stale once it changes
+struct PackSource
+{
+    char path[256];
+    int64_t modification_time;
+    uint64_t size;
+};
+
+/// Indexed, cache optimized mesh in GPU layout
+struct PackMesh
+{
+    char name[64];
+    uint32_t vertex_count, index_count;
+    uint64_t vertices_offset; // PackedVertex[vertex_count]
+    uint64_t indices_offset;  // uint32_t[index_count], 3 per triangle
+    int32_t diffuse_texture, roughness_texture; // Into the texture table, -1 if none
+    uint32_t has_texture_coordinates, reserved;
+};
+
+/// Mip chain in a TextureFormat, level i is max(1, width >> i) x max(1, height >> i) and follows level i - 1
+struct PackTexture
+{
+    char path[256];
+    uint32_t width, height, levels, format;
+    uint64_t offset;
+};
+
+/// Read-only memory mapping of a baked pack, meshes and textures are used straight from the mapping
+class AssetPack
+{
+public:
+    AssetPack() = default;
+    ~AssetPack();
+    AssetPack(const AssetPack &) = delete;
+    AssetPack &operator=(const AssetPack &) = delete;
+
+    /// Maps the pack and checks its header, tables and every mesh and texture range against the mapping.
+    /// Prints why and returns false if it can't be used.
+    bool open(const char *path);
+    /// True if a source file changed since baking. Missing sources count as unchanged, packs may ship without them.
+    bool is_stale() const;
+
+    const PackHeader &header() const { return *(const PackHeader *)memory; }
+    const PackSource &source(uint32_t i) const { return ((const PackSource *)at(header().sources_offset))[i]; }
+    const PackMesh &mesh(uint32_t i) const { return ((const PackMesh *)at(header().meshes_offset))[i]; }
+    const PackTexture &texture(uint32_t i) const { return ((const PackTexture *)at(header().textures_offset))[i]; }
+    const void *at(uint64_t offset) const { return memory + offset; }
+
+private:
+    const unsigned char *memory = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    void *file = nullptr, *mapping = nullptr;
+#endif
+
+    void close();
+    /// True if every table and payload lies within the mapping and every entry is consistent
+    bool validate(const char *path) const;
+    /// True if count elements of element_size bytes starting at offset fit into the mapping
+    bool fits(uint64_t offset, uint64_t count, size_t element_size) const;
+};
+
+/// Modification time and size of a file, false if it doesn't exist
+bool stat_source(const char *path, int64_t &modification_time, uint64_t &size);
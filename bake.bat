@@ -0,0 +1,2 @@
+g++.exe .\bake.cpp .\asset_pack.cpp .\mesh_optimizer.cpp .\mip_chain.cpp .\texture_compression.cpp -o bake.exe -lassimp -llodepng
+.\bake.exe statek.obj statek.pack
\ No newline at end of file
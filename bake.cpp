@@ -0,0 +1,230 @@
+// Offline bake of a model into an asset pack: indexed, cache optimized meshes in GPU layout
+// and block compressed texture mip chains, ready to be mapped and uploaded as they are.
+// Usage: bake.out model.obj model.pack
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+#include <lodepng.h>
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "asset_pack.hpp"
+#include "mesh_optimizer.hpp"
+#include "mip_chain.hpp"
+#include "texture_compression.hpp"
+
+// Store diffuse maps as BC1/BC3 and roughness maps as BC4 instead of RGBA8
+#define bake_compress_textures 1
+
+struct BakedMesh
+{
+    PackMesh entry;
+    std::vector<PackedVertex> vertices;
+    std::vector<glm::ivec3> faces;
+};
+
+struct BakedTexture
+{
+    PackTexture entry;
+    MipChain chain;
+    std::vector<unsigned char> data; // All levels in entry.format
+    bool single_channel;             // Encoded for a roughness map, see encode_texture
+};
+
+static void copy_string(char *destination, size_t capacity, const std::string &source)
+{
+    strncpy(destination, source.c_str(), capacity - 1);
+    destination[capacity - 1] = 0;
+}
+
+// Encodes every level of the chain, single channel maps keep only red
+static void encode_texture(BakedTexture &texture, bool single_channel)
+{
+    const MipChain &chain = texture.chain;
+    TextureFormat format = TEXTURE_RGBA8;
+#if bake_compress_textures
+    format = single_channel ? TEXTURE_BC4 : choose_color_format(chain.pixels.data(), chain.width, chain.height);
+#endif
+
+    texture.entry.format = format;
+    texture.data.resize(texture_chain_size(format, chain.width, chain.height, chain.levels));
+    size_t offset = 0;
+    for (unsigned level = 0; level < chain.levels; ++level)
+    {
+        unsigned width = chain.level_width(level), height = chain.level_height(level);
+        compress_texture(format, &chain.pixels[chain.level_offset(level)], width, height, &texture.data[offset]);
+        offset += texture_level_size(format, width, height);
+    }
+}
+
+// Index of the texture in textures, decoded on first use. -1 if it can't be read.
+// An image used both as a color and a single channel map is baked once for each, the encodings differ.
+static int32_t bake_texture(std::vector<BakedTexture> &textures, const std::string &path, bool single_channel)
+{
+    for (size_t i = 0; i < textures.size(); ++i)
+        if (path == textures[i].entry.path && single_channel == textures[i].single_channel)
+            return i;
+
+    BakedTexture texture = {};
+    if (unsigned error = lodepng::decode(texture.chain.pixels, texture.chain.width, texture.chain.height, path))
+    {
+        printf("%s: %s\n", path.c_str(), lodepng_error_text(error));
+        return -1;
+    }
+    if (texture.chain.width > asset_pack_max_texture_size || texture.chain.height > asset_pack_max_texture_size)
+    {
+        printf("%s: %ux%u is larger than a pack allows\n", path.c_str(), texture.chain.width, texture.chain.height);
+        return -1;
+    }
+
+    build_mip_chain(texture.chain);
+    copy_string(texture.entry.path, sizeof(texture.entry.path), path);
+    texture.entry.width = texture.chain.width;
+    texture.entry.height = texture.chain.height;
+    texture.entry.levels = texture.chain.levels;
+    texture.single_channel = single_channel;
+    encode_texture(texture, single_channel);
+    printf("Texture %s: %ux%u, %u levels, format %u, %zu bytes\n", path.c_str(), texture.chain.width, texture.chain.height,
+           texture.chain.levels, texture.entry.format, texture.data.size());
+    textures.push_back(std::move(texture));
+    return textures.size() - 1;
+}
+
+static int32_t bake_material_texture(std::vector<BakedTexture> &textures, const aiMaterial *material, aiTextureType type)
+{
+    aiString path;
+    if (material->GetTextureCount(type) > 0 && material->GetTexture(type, 0, &path) == AI_SUCCESS)
+        // Roughness is sampled as a single grey value
+        return bake_texture(textures, path.C_Str(), type == aiTextureType_SHININESS);
+    return -1;
+}
+
+static BakedMesh bake_mesh(const aiMesh *mesh, const aiScene *scene, std::vector<BakedTexture> &textures)
+{
+    std::vector<glm::vec4> positions, normals;
+    std::vector<glm::vec2> texture_coordinates;
+    std::vector<glm::ivec3> faces;
+
+    for (unsigned i = 0; i < mesh->mNumVertices; ++i)
+    {
+        positions.push_back(glm::vec4(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z, 1));
+        normals.push_back(glm::vec4(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z, 0));
+    }
+    for (unsigned i = 0; i < mesh->mNumFaces; ++i)
+        faces.push_back(glm::ivec3(mesh->mFaces[i].mIndices[0], mesh->mFaces[i].mIndices[1], mesh->mFaces[i].mIndices[2]));
+
+    BakedMesh baked = {};
+    copy_string(baked.entry.name, sizeof(baked.entry.name), mesh->mName.C_Str());
+    baked.entry.has_texture_coordinates = mesh->HasTextureCoords(0);
+    baked.entry.diffuse_texture = baked.entry.roughness_texture = -1;
+    if (baked.entry.has_texture_coordinates)
+    {
+        for (unsigned i = 0; i < mesh->mNumVertices; ++i)
+            texture_coordinates.push_back(glm::vec2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y));
+
+        const aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
+        baked.entry.diffuse_texture = bake_material_texture(textures, material, aiTextureType_DIFFUSE);
+        baked.entry.roughness_texture = bake_material_texture(textures, material, aiTextureType_SHININESS);
+    }
+
+    const float acmr_before = average_cache_miss_ratio(faces, positions.size());
+    const unsigned vertices_before = positions.size();
+    optimize_mesh(positions, normals, texture_coordinates, faces);
+    baked.vertices = pack_vertices(positions, normals, texture_coordinates);
+    baked.faces = faces;
+    baked.entry.vertex_count = baked.vertices.size();
+    baked.entry.index_count = faces.size() * 3;
+    printf("Mesh %s: %u -> %u vertices, %u triangles, ACMR %.3f -> %.3f\n", baked.entry.name, vertices_before, baked.entry.vertex_count,
+           (unsigned)faces.size(), acmr_before, average_cache_miss_ratio(faces, baked.entry.vertex_count));
+    return baked;
+}
+
+// Appends size bytes at the next aligned offset and returns that offset
+static uint64_t append(std::vector<unsigned char> &pack, const void *data, size_t size)
+{
+    uint64_t offset = (pack.size() + asset_pack_alignment - 1) / asset_pack_alignment * asset_pack_alignment;
+    pack.resize(offset + size);
+    if (size)
+        memcpy(&pack[offset], data, size);
+    return offset;
+}
+
+static void add_source(std::vector<PackSource> &sources, const std::string &path)
+{
+    PackSource source = {};
+    copy_string(source.path, sizeof(source.path), path);
+    if (stat_source(path.c_str(), source.modification_time, source.size))
+        sources.push_back(source);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 3)
+    {
+        fprintf(stderr, "Usage: %s model.obj model.pack\n", argv[0]);
+        return 1;
+    }
+    std::string model = argv[1];
+
+    Assimp::Importer importer;
+    const aiScene *scene = importer.ReadFile(model, aiProcess_Triangulate | aiProcess_FlipUVs);
+    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+    {
+        fprintf(stderr, "ERROR::ASSIMP::%s\n", importer.GetErrorString());
+        return 1;
+    }
+
+    std::vector<BakedMesh> meshes;
+    std::vector<BakedTexture> textures;
+    for (unsigned i = 0; i < scene->mNumMeshes; ++i)
+        meshes.push_back(bake_mesh(scene->mMeshes[i], scene, textures));
+
+    // The model, its material library next to it and every texture
+    std::vector<PackSource> sources;
+    add_source(sources, model);
+    add_source(sources, model.substr(0, model.find_last_of('.')) + ".mtl");
+    for (const BakedTexture &texture : textures)
+        add_source(sources, texture.entry.path);
+
+    std::vector<unsigned char> pack;
+    PackHeader header = {};
+    append(pack, &header, sizeof(header));
+    for (BakedMesh &mesh : meshes)
+    {
+        mesh.entry.vertices_offset = append(pack, mesh.vertices.data(), mesh.vertices.size() * sizeof(PackedVertex));
+        mesh.entry.indices_offset = append(pack, mesh.faces.data(), mesh.faces.size() * sizeof(glm::ivec3));
+    }
+    for (BakedTexture &texture : textures)
+        texture.entry.offset = append(pack, texture.data.data(), texture.data.size());
+
+    std::vector<PackMesh> mesh_table;
+    std::vector<PackTexture> texture_table;
+    for (const BakedMesh &mesh : meshes)
+        mesh_table.push_back(mesh.entry);
+    for (const BakedTexture &texture : textures)
+        texture_table.push_back(texture.entry);
+
+    header.magic = asset_pack_magic;
+    header.version = asset_pack_version;
+    header.source_count = sources.size();
+    header.mesh_count = mesh_table.size();
+    header.texture_count = texture_table.size();
+    header.sources_offset = append(pack, sources.data(), sources.size() * sizeof(PackSource));
+    header.meshes_offset = append(pack, mesh_table.data(), mesh_table.size() * sizeof(PackMesh));
+    header.textures_offset = append(pack, texture_table.data(), texture_table.size() * sizeof(PackTexture));
+    header.file_size = pack.size();
+    memcpy(pack.data(), &header, sizeof(header));
+
+    FILE *file = fopen(argv[2], "wb");
+    if (!file || fwrite(pack.data(), 1, pack.size(), file) != pack.size())
+    {
+        fprintf(stderr, "Can't write %s\n", argv[2]);
+        return 1;
+    }
+    fclose(file);
+    printf("%s: %zu bytes\n", argv[2], pack.size());
+    return 0;
+}
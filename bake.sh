@@ -0,0 +1 @@
+g++ bake.cpp asset_pack.cpp mesh_optimizer.cpp mip_chain.cpp texture_compression.cpp -o bake.out -lassimp -llodepng && ./bake.out statek.obj statek.pack
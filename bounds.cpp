@@ -0,0 +1,152 @@
+#include "bounds.hpp"
+#include "frame_arena.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define frustum_culling_sse 1
+#else
+#define frustum_culling_sse 0
+#endif
+
+Bounds compute_bounds(const glm::vec3 *positions, size_t count, size_t stride)
+{
+    Bounds b;
+    if (count == 0)
+        return b;
+
+    const char *bytes = (const char *)positions;
+    glm::vec3 low(FLT_MAX), high(-FLT_MAX);
+    for (size_t i = 0; i < count; ++i)
+    {
+        const glm::vec3 &p = *(const glm::vec3 *)(bytes + i * stride);
+        low = glm::min(low, p);
+        high = glm::max(high, p);
+    }
+    b.center = (low + high) * 0.5f;
+    b.extent = (high - low) * 0.5f;
+
+    // Around the box center, usually tighter than the box's own corner distance
+    float radius_squared = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        glm::vec3 d = *(const glm::vec3 *)(bytes + i * stride) - b.center;
+        radius_squared = std::max(radius_squared, glm::dot(d, d));
+    }
+    b.radius = sqrtf(radius_squared);
+    return b;
+}
+
+Bounds transform_bounds(const Bounds &b, const glm::mat4 &M)
+{
+    Bounds result;
+    result.center = glm::vec3(M * glm::vec4(b.center, 1));
+    // Arvo: every new half size is the extents projected on that axis of M
+    for (int row = 0; row < 3; ++row)
+        result.extent[row] = fabsf(M[0][row]) * b.extent.x + fabsf(M[1][row]) * b.extent.y + fabsf(M[2][row]) * b.extent.z;
+    float scale = std::max(glm::length(glm::vec3(M[0])), std::max(glm::length(glm::vec3(M[1])), glm::length(glm::vec3(M[2]))));
+    result.radius = b.radius * scale;
+    return result;
+}
+
+Frustum::Frustum(const glm::mat4 &VP)
+{
+    // Row i of VP, glm stores columns
+    glm::vec4 rows[4];
+    for (int i = 0; i < 4; ++i)
+        rows[i] = glm::vec4(VP[0][i], VP[1][i], VP[2][i], VP[3][i]);
+
+    for (int i = 0; i < 3; ++i)
+    {
+        planes[2 * i] = rows[3] + rows[i];
+        planes[2 * i + 1] = rows[3] - rows[i];
+    }
+    for (glm::vec4 &plane : planes)
+        plane /= glm::length(glm::vec3(plane));
+}
+
+bool Frustum::intersects(const Bounds &b) const
+{
+    for (const glm::vec4 &plane : planes)
+    {
+        float distance = glm::dot(glm::vec3(plane), b.center) + plane.w;
+        float box_radius = fabsf(plane.x) * b.extent.x + fabsf(plane.y) * b.extent.y + fabsf(plane.z) * b.extent.z;
+        if (distance < -std::min(box_radius, b.radius))
+            return false;
+    }
+    return true;
+}
+
+FrustumCuller::FrustumCuller(size_t capacity)
+{
+    // Rounded up to whole SSE lanes, the padding is tested but never read
+    this->capacity = (capacity + 3) & ~(size_t)3;
+    count = 0;
+    float **arrays[] = {&center_x, &center_y, &center_z, &extent_x, &extent_y, &extent_z, &radius};
+    for (float **array : arrays)
+        *array = (float *)frame_arena().allocate(this->capacity * sizeof(float), 16);
+    visible = (uint8_t *)frame_arena().allocate(this->capacity, 1);
+}
+
+size_t FrustumCuller::add(const Bounds &b)
+{
+    assert(count < capacity);
+    center_x[count] = b.center.x;
+    center_y[count] = b.center.y;
+    center_z[count] = b.center.z;
+    extent_x[count] = b.extent.x;
+    extent_y[count] = b.extent.y;
+    extent_z[count] = b.extent.z;
+    radius[count] = b.radius;
+    return count++;
+}
+
+void FrustumCuller::cull(const Frustum &frustum)
+{
+    size_t padded = (count + 3) & ~(size_t)3;
+    for (size_t i = count; i < padded; ++i)
+        center_x[i] = center_y[i] = center_z[i] = extent_x[i] = extent_y[i] = extent_z[i] = radius[i] = 0;
+
+    stats.tested = count;
+    stats.visible = 0;
+#if frustum_culling_sse
+    const __m128 sign_mask = _mm_set1_ps(-0.f);
+    for (size_t i = 0; i < padded; i += 4)
+    {
+        __m128 cx = _mm_load_ps(center_x + i), cy = _mm_load_ps(center_y + i), cz = _mm_load_ps(center_z + i);
+        __m128 ex = _mm_load_ps(extent_x + i), ey = _mm_load_ps(extent_y + i), ez = _mm_load_ps(extent_z + i);
+        __m128 r = _mm_load_ps(radius + i);
+        __m128 inside = _mm_cmpeq_ps(_mm_setzero_ps(), _mm_setzero_ps()); // All lanes set
+        for (const glm::vec4 &plane : frustum.planes)
+        {
+            __m128 px = _mm_set1_ps(plane.x), py = _mm_set1_ps(plane.y), pz = _mm_set1_ps(plane.z);
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, cx), _mm_mul_ps(py, cy)), _mm_add_ps(_mm_mul_ps(pz, cz), _mm_set1_ps(plane.w)));
+            __m128 box_radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(sign_mask, px), ex), _mm_mul_ps(_mm_andnot_ps(sign_mask, py), ey)),
+                                           _mm_mul_ps(_mm_andnot_ps(sign_mask, pz), ez));
+            // Outside when the whole volume is behind the plane
+            __m128 outside = _mm_cmplt_ps(_mm_add_ps(distance, _mm_min_ps(box_radius, r)), _mm_setzero_ps());
+            inside = _mm_andnot_ps(outside, inside);
+        }
+
+        int mask = _mm_movemask_ps(inside);
+        for (size_t lane = 0; lane < 4 && i + lane < count; ++lane)
+        {
+            visible[i + lane] = mask >> lane & 1;
+            stats.visible += visible[i + lane];
+        }
+    }
+#else
+    for (size_t i = 0; i < count; ++i)
+    {
+        Bounds b;
+        b.center = glm::vec3(center_x[i], center_y[i], center_z[i]);
+        b.extent = glm::vec3(extent_x[i], extent_y[i], extent_z[i]);
+        b.radius = radius[i];
+        visible[i] = frustum.intersects(b);
+        stats.visible += visible[i];
+    }
+#endif
+}
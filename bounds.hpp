@@ -0,0 +1,53 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+/// Axis aligned box and a sphere sharing its center, a volume has to pass both tests to be visible
+struct Bounds
+{
+    glm::vec3 center = glm::vec3(0);
+    glm::vec3 extent = glm::vec3(0); // Half size of the box
+    float radius = 0;
+};
+
+/// Bounds of count positions spaced stride bytes apart
+Bounds compute_bounds(const glm::vec3 *positions, size_t count, size_t stride = sizeof(glm::vec3));
+/// Bounds of b after M, the box is the one around the transformed box, the sphere grows with the largest scale
+Bounds transform_bounds(const Bounds &b, const glm::mat4 &M);
+
+/// Planes of a view frustum, normals point inwards and are normalized
+struct Frustum
+{
+    glm::vec4 planes[6]; // Left, right, bottom, top, near, far
+
+    /// Extracts the planes of a projection * view matrix (Gribb & Hartmann)
+    explicit Frustum(const glm::mat4 &VP);
+    /// Single test, FrustumCuller tests many at once
+    bool intersects(const Bounds &b) const;
+};
+
+struct CullStats
+{
+    size_t tested = 0, visible = 0;
+};
+
+/// Frustum test of a batch of world space bounds, four per SSE instruction.
+/// The bounds are kept in structure of arrays form in the frame arena, so a culler only lives for one frame.
+class FrustumCuller
+{
+public:
+    explicit FrustumCuller(size_t capacity);
+
+    /// Queues b and returns its index
+    size_t add(const Bounds &b);
+    void cull(const Frustum &frustum);
+    bool is_visible(size_t i) const { return visible[i]; }
+    CullStats get_stats() const { return stats; }
+
+private:
+    size_t capacity, count;
+    float *center_x, *center_y, *center_z, *extent_x, *extent_y, *extent_z, *radius;
+    uint8_t *visible;
+    CullStats stats;
+};
@@ -1,2 +1,2 @@
-g++.exe .\main.cpp .\shaderprogram.cpp .\mesh.cpp .\particle_system.cpp -o main.exe -lopengl32 -lglfw3 -lglew32 -llodepng -lassimp
+g++.exe .\main.cpp .\shaderprogram.cpp .\mesh.cpp .\mesh_optimizer.cpp .\particle_system.cpp .\frame_uniforms.cpp .\ocean.cpp .\frame_arena.cpp .\random_stream.cpp .\particle_manager.cpp .\job_system.cpp .\asset_pack.cpp .\asset_loader.cpp .\texture_cache.cpp .\mip_chain.cpp .\texture_compression.cpp .\bounds.cpp .\render_queue.cpp .\gl_state.cpp -o main.exe -lopengl32 -lglfw3 -lglew32 -llodepng -lassimp
 .\main.exe
\ No newline at end of file
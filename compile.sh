@@ -1 +1 @@
-g++ main.cpp shaderprogram.cpp mesh.cpp particle_system.cpp -o main.out -lGL -lglfw -lGLEW -llodepng -lassimp && ./main.out
\ No newline at end of file
+g++ main.cpp shaderprogram.cpp mesh.cpp mesh_optimizer.cpp particle_system.cpp frame_uniforms.cpp ocean.cpp frame_arena.cpp random_stream.cpp particle_manager.cpp job_system.cpp asset_pack.cpp asset_loader.cpp texture_cache.cpp mip_chain.cpp texture_compression.cpp bounds.cpp render_queue.cpp gl_state.cpp -o main.out -pthread -lGL -lglfw -lGLEW -llodepng -lassimp && ./main.out
\ No newline at end of file
@@ -0,0 +1,31 @@
+#version 330
+
+uniform vec4 surfaceColor=vec4(0,0,0,1);
+uniform vec4 lightColor = vec4(1,0,0,1);
+
+out vec4 pixelColor; //Output variable of the fragment shader. (Almost) final pixel color.
+
+//Varying variables
+in vec3 lightDir;
+in vec2 corner;
+in float radius;
+in float alpha;
+
+void main(void) {
+    //Normal of the sphere the billboard stands in for, outside of it nothing is drawn
+    float r2 = dot(corner, corner);
+    if (r2 > 1)
+        discard;
+    vec3 normal = vec3(corner, sqrt(1-r2));
+    //The sphere's surface is in front of the quad
+    vec3 toLight = lightDir-vec3(0, 0, normal.z*radius);
+
+	pixelColor=surfaceColor
+    +lightColor
+    *clamp(dot(
+        normalize(toLight),
+        normal
+    ),0,1)
+    *0.8/(length(toLight)-0.5);
+    pixelColor.a = alpha;
+}
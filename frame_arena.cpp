@@ -0,0 +1,119 @@
+#include "frame_arena.hpp"
+#include <cstdlib>
+#include <cstdint>
+#include <new>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+// 1 MiB covers the transient buffers of a frame, the arena grows itself if it doesn't
+#define frame_arena_capacity (1 << 20)
+
+// Per thread, so the GL and simulation threads can each check their own frame path
+static thread_local unsigned long heap_allocations = 0;
+
+// Every C++ heap allocation goes through here, which is what heap_allocation_count reports
+void *operator new(size_t size)
+{
+    ++heap_allocations;
+    if (void *memory = malloc(size ? size : 1))
+        return memory;
+    throw std::bad_alloc();
+}
+
+// Over-aligned types, e.g. the particle pool
+void *operator new(size_t size, std::align_val_t alignment)
+{
+    ++heap_allocations;
+    size_t align = (size_t)alignment;
+#ifdef _WIN32
+    if (void *memory = _aligned_malloc(size ? size : 1, align))
+        return memory;
+#else
+    // aligned_alloc wants a multiple of the alignment
+    if (void *memory = aligned_alloc(align, (size + align - 1) / align * align))
+        return memory;
+#endif
+    throw std::bad_alloc();
+}
+
+void operator delete(void *memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void *memory, std::align_val_t) noexcept
+{
+#ifdef _WIN32
+    _aligned_free(memory);
+#else
+    free(memory);
+#endif
+}
+
+void operator delete(void *memory, size_t, std::align_val_t alignment) noexcept
+{
+    operator delete(memory, alignment);
+}
+
+unsigned long heap_allocation_count()
+{
+    return heap_allocations;
+}
+
+FrameArena::FrameArena(size_t capacity)
+{
+    this->capacity = capacity;
+    memory = new char[capacity];
+    used = 0;
+    overflow_bytes = 0;
+}
+
+FrameArena::~FrameArena()
+{
+    reset();
+    delete[] memory;
+}
+
+void *FrameArena::allocate(size_t size, size_t alignment)
+{
+    uintptr_t start = ((uintptr_t)memory + used + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    if (start + size <= (uintptr_t)memory + capacity)
+    {
+        used = start + size - (uintptr_t)memory;
+        return (void *)start;
+    }
+
+    // Out of space, serve this frame from the heap and remember how much more the next one needs
+    char *block = new char[size + alignment];
+    overflow.push_back(block);
+    overflow_bytes += size + alignment;
+    return (void *)(((uintptr_t)block + alignment - 1) & ~(uintptr_t)(alignment - 1));
+}
+
+void FrameArena::reset()
+{
+    if (!overflow.empty())
+    {
+        for (char *block : overflow)
+            delete[] block;
+        overflow.clear();
+
+        capacity = (used + overflow_bytes) * 2;
+        delete[] memory;
+        memory = new char[capacity];
+    }
+    used = 0;
+    overflow_bytes = 0;
+}
+
+FrameArena &frame_arena()
+{
+    static FrameArena arena(frame_arena_capacity);
+    return arena;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+/// Linear allocator for data that only lives during one frame.
+/// Allocations bump an offset and are never freed one by one, reset() releases everything at once.
+class FrameArena
+{
+public:
+    explicit FrameArena(size_t capacity);
+    ~FrameArena();
+
+    void *allocate(size_t size, size_t alignment);
+    /// Starts a new frame. If the last frame overflowed, the block is grown so the next one fits without heap allocations.
+    void reset();
+
+    size_t get_used() const { return used + overflow_bytes; }
+    size_t get_capacity() const { return capacity; }
+
+private:
+    char *memory;
+    size_t capacity, used;
+    // Heap blocks handed out after the arena ran out, freed on reset
+    std::vector<char *> overflow;
+    size_t overflow_bytes;
+};
+
+/// Arena reset at the top of every drawScene
+FrameArena &frame_arena();
+
+/// STL allocator adapter over frame_arena(), deallocation is a no-op
+template <typename T>
+struct FrameAllocator
+{
+    typedef T value_type;
+
+    FrameAllocator() = default;
+    template <typename U>
+    FrameAllocator(const FrameAllocator<U> &) {}
+
+    T *allocate(size_t n) { return (T *)frame_arena().allocate(n * sizeof(T), alignof(T)); }
+    void deallocate(T *, size_t) {}
+};
+
+template <typename T, typename U>
+bool operator==(const FrameAllocator<T> &, const FrameAllocator<U> &) { return true; }
+template <typename T, typename U>
+bool operator!=(const FrameAllocator<T> &, const FrameAllocator<U> &) { return false; }
+
+/// Vector that must not outlive the frame it was created in
+template <typename T>
+using frame_vector = std::vector<T, FrameAllocator<T>>;
+
+/// Number of operator new calls the calling thread made since it started, aligned ones included.
+/// Compare across a frame to count the heap allocations of its path on that thread, work handed to job workers isn't included.
+unsigned long heap_allocation_count();
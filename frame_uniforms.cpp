@@ -0,0 +1,39 @@
+#include "frame_uniforms.hpp"
+#include <glm/gtc/type_ptr.hpp>
+#include "gl_state.hpp"
+
+FrameUniformBuffer::FrameUniformBuffer()
+{
+    glGenBuffers(1, &buffer);
+    gl_state().bind_buffer(GL_UNIFORM_BUFFER, buffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), nullptr, GL_STREAM_DRAW);
+    gl_state().bind_buffer_base(GL_UNIFORM_BUFFER, frame_block_binding, buffer);
+}
+
+FrameUniformBuffer::~FrameUniformBuffer()
+{
+    gl_state().delete_buffers(1, &buffer);
+}
+
+void FrameUniformBuffer::update(const FrameUniforms &data)
+{
+    gl_state().bind_buffer(GL_UNIFORM_BUFFER, buffer);
+    // Orphan the previous frame's copy instead of waiting for draws still reading it
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms), &data);
+}
+
+void upload_model_transforms(ShaderProgram *sp, const FrameUniforms &frame, const glm::mat4 &M)
+{
+    if (sp->getUniformLocation(UNIFORM_M) != -1)
+        glUniformMatrix4fv(sp->getUniformLocation(UNIFORM_M), 1, false, glm::value_ptr(M));
+    if (sp->getUniformLocation(UNIFORM_MV) != -1)
+        glUniformMatrix4fv(sp->getUniformLocation(UNIFORM_MV), 1, false, glm::value_ptr(frame.V * M));
+    if (sp->getUniformLocation(UNIFORM_MVP) != -1)
+        glUniformMatrix4fv(sp->getUniformLocation(UNIFORM_MVP), 1, false, glm::value_ptr(frame.VP * M));
+    if (sp->getUniformLocation(UNIFORM_NORMAL_MATRIX) != -1)
+    {
+        glm::mat3 normal_matrix = glm::transpose(glm::inverse(glm::mat3(M)));
+        glUniformMatrix3fv(sp->getUniformLocation(UNIFORM_NORMAL_MATRIX), 1, false, glm::value_ptr(normal_matrix));
+    }
+}
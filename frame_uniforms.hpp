@@ -0,0 +1,35 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "shaderprogram.h"
+
+// Uniform buffer binding point of the Frame block, every ShaderProgram binds it here
+#define frame_block_binding 0
+
+/// Data shared by all draws of a frame, mirrors the std140 Frame block declared in the vertex shaders.
+/// Only mat4 and vec4 members, so the C++ layout already matches std140.
+struct FrameUniforms
+{
+    glm::mat4 P;
+    glm::mat4 V;
+    glm::mat4 VP;               // P*V
+    glm::vec4 camera_position;  // World space
+    glm::vec4 light_position;   // World space, white light
+    glm::vec4 red_light_source; // World space, chimney light
+};
+
+class FrameUniformBuffer
+{
+public:
+    FrameUniformBuffer();
+    ~FrameUniformBuffer();
+
+    /// Uploads the frame data, call once per frame before the first draw
+    void update(const FrameUniforms &data);
+
+private:
+    GLuint buffer;
+};
+
+/// Uploads M and the per-draw products the active program uses (MV, MVP, normalMatrix), so shaders don't rebuild them per vertex
+void upload_model_transforms(ShaderProgram *sp, const FrameUniforms &frame, const glm::mat4 &M);
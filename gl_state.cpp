@@ -0,0 +1,201 @@
+#include "gl_state.hpp"
+
+// ~0u is never a valid name or enum, so it marks a binding as unknown
+static const GLuint unknown = ~0u;
+
+static const GLenum buffer_targets[] = {GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER, GL_UNIFORM_BUFFER, GL_PIXEL_UNPACK_BUFFER, GL_TRANSFORM_FEEDBACK_BUFFER};
+static const GLenum capability_names[] = {GL_DEPTH_TEST, GL_BLEND, GL_CULL_FACE, GL_RASTERIZER_DISCARD};
+
+template <typename T, size_t N>
+static int find_index(const T (&values)[N], T value)
+{
+    for (size_t i = 0; i < N; ++i)
+        if (values[i] == value)
+            return i;
+    return -1;
+}
+
+GLState::GLState()
+{
+    invalidate();
+}
+
+template <typename T>
+bool GLState::update(T &shadow, T value)
+{
+#if gl_state_filtering
+    if (shadow == value)
+    {
+        ++stats.filtered;
+        return false;
+    }
+#endif
+    shadow = value;
+    ++stats.issued;
+    return true;
+}
+
+void GLState::use_program(GLuint program)
+{
+    if (update(this->program, program))
+        glUseProgram(program);
+}
+
+void GLState::activate_unit(unsigned unit)
+{
+    if (update(active_unit, unit))
+        glActiveTexture(GL_TEXTURE0 + unit);
+}
+
+void GLState::bind_texture(unsigned unit, GLuint texture)
+{
+    if (unit >= gl_state_texture_units)
+    {
+        activate_unit(unit);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        ++stats.issued;
+        return;
+    }
+#if gl_state_filtering
+    if (textures[unit] == texture)
+    {
+        ++stats.filtered;
+        return;
+    }
+#endif
+    activate_unit(unit);
+    textures[unit] = texture;
+    glBindTexture(GL_TEXTURE_2D, texture);
+    ++stats.issued;
+}
+
+void GLState::bind_vertex_array(GLuint vertex_array)
+{
+    if (update(this->vertex_array, vertex_array))
+    {
+        glBindVertexArray(vertex_array);
+        buffers[find_index(buffer_targets, (GLenum)GL_ELEMENT_ARRAY_BUFFER)] = unknown;
+    }
+}
+
+void GLState::bind_buffer(GLenum target, GLuint buffer)
+{
+    int slot = find_index(buffer_targets, target);
+    if (slot < 0)
+    {
+        glBindBuffer(target, buffer);
+        ++stats.issued;
+        return;
+    }
+    if (update(buffers[slot], buffer))
+        glBindBuffer(target, buffer);
+}
+
+void GLState::bind_buffer_base(GLenum target, GLuint index, GLuint buffer)
+{
+    glBindBufferBase(target, index, buffer);
+    ++stats.issued;
+    int slot = find_index(buffer_targets, target);
+    if (slot >= 0)
+        buffers[slot] = buffer;
+}
+
+void GLState::set_enabled(GLenum capability, bool enabled)
+{
+    int slot = find_index(capability_names, capability);
+    if (slot >= 0 && !update(capabilities[slot], (int)enabled))
+        return;
+    if (slot < 0)
+        ++stats.issued;
+
+    if (enabled)
+        glEnable(capability);
+    else
+        glDisable(capability);
+}
+
+void GLState::depth_mask(bool enabled)
+{
+    if (update(depth_write, (int)enabled))
+        glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+}
+
+void GLState::blend_func(GLenum source, GLenum destination)
+{
+#if gl_state_filtering
+    if (blend_source == source && blend_destination == destination)
+    {
+        ++stats.filtered;
+        return;
+    }
+#endif
+    blend_source = source;
+    blend_destination = destination;
+    glBlendFunc(source, destination);
+    ++stats.issued;
+}
+
+void GLState::delete_textures(GLsizei count, const GLuint *textures)
+{
+    for (GLsizei i = 0; i < count; ++i)
+        for (GLuint &bound : this->textures)
+            if (bound == textures[i])
+                bound = 0;
+    glDeleteTextures(count, textures);
+}
+
+void GLState::delete_buffers(GLsizei count, const GLuint *buffers)
+{
+    for (GLsizei i = 0; i < count; ++i)
+        for (GLuint &bound : this->buffers)
+            if (bound == buffers[i])
+                bound = 0;
+    glDeleteBuffers(count, buffers);
+}
+
+void GLState::delete_vertex_arrays(GLsizei count, const GLuint *vertex_arrays)
+{
+    for (GLsizei i = 0; i < count; ++i)
+        if (vertex_array == vertex_arrays[i])
+        {
+            // Deleting the bound vertex array reverts to the default one, whose element binding isn't known
+            vertex_array = 0;
+            buffers[find_index(buffer_targets, (GLenum)GL_ELEMENT_ARRAY_BUFFER)] = unknown;
+        }
+    glDeleteVertexArrays(count, vertex_arrays);
+}
+
+void GLState::delete_program(GLuint program)
+{
+    // A program in use is only deleted once it isn't, until then the name stays taken
+    if (this->program == program)
+        this->program = unknown;
+    glDeleteProgram(program);
+}
+
+void GLState::invalidate()
+{
+    program = vertex_array = active_unit = unknown;
+    for (GLuint &texture : textures)
+        texture = unknown;
+    for (GLuint &buffer : buffers)
+        buffer = unknown;
+    for (int &capability : capabilities)
+        capability = -1;
+    depth_write = -1;
+    blend_source = blend_destination = unknown;
+}
+
+void GLState::count(bool issued)
+{
+    if (issued)
+        ++stats.issued;
+    else
+        ++stats.filtered;
+}
+
+GLState &gl_state()
+{
+    static GLState state;
+    return state;
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <GL/glew.h>
+#include <cstddef>
+
+// Skip GL calls that would set state the context already has, 0 issues every call for comparison
+#define gl_state_filtering 1
+// Texture units whose GL_TEXTURE_2D binding is shadowed, binds to higher units always reach GL
+#define gl_state_texture_units 8
+
+struct GLStateStats
+{
+    size_t issued = 0, filtered = 0;
+};
+
+/// Shadow copy of the context state the draw paths touch: program, GL_TEXTURE_2D of each unit, vertex array,
+/// buffer bindings, capabilities, depth mask and blend function. Setters only reach GL when the value changes,
+/// so a draw can set everything it needs without knowing what the previous one left bound.
+/// Every bind of these kinds has to go through here, a raw GL call leaves the shadow stale. GL thread only.
+class GLState
+{
+public:
+    /// Everything starts unknown, the first setter of each kind reaches GL
+    GLState();
+
+    void use_program(GLuint program);
+    /// Binds texture to GL_TEXTURE_2D of unit, the active unit only changes when the binding does
+    void bind_texture(unsigned unit, GLuint texture);
+    /// The element buffer binding is part of the vertex array, it becomes unknown
+    void bind_vertex_array(GLuint vertex_array);
+    void bind_buffer(GLenum target, GLuint buffer);
+    /// Indexed bindings aren't shadowed, but they replace the generic binding of target as well
+    void bind_buffer_base(GLenum target, GLuint index, GLuint buffer);
+    /// GL_DEPTH_TEST, GL_BLEND, GL_CULL_FACE and GL_RASTERIZER_DISCARD are shadowed
+    void set_enabled(GLenum capability, bool enabled);
+    void depth_mask(bool enabled);
+    void blend_func(GLenum source, GLenum destination);
+
+    /// GL unbinds deleted objects and may hand their names out again, so they are dropped from the shadow
+    void delete_textures(GLsizei count, const GLuint *textures);
+    void delete_buffers(GLsizei count, const GLuint *buffers);
+    void delete_vertex_arrays(GLsizei count, const GLuint *vertex_arrays);
+    void delete_program(GLuint program);
+
+    /// Forgets everything, for after code that changed state behind the cache's back
+    void invalidate();
+
+    /// Records a state call filtered elsewhere, e.g. a sampler uniform by its program
+    void count(bool issued);
+    GLStateStats get_stats() const { return stats; }
+    void reset_stats() { stats = GLStateStats(); }
+
+private:
+    enum
+    {
+        BUFFER_TARGETS = 5,
+        CAPABILITIES = 4
+    };
+
+    GLuint program, vertex_array;
+    GLuint active_unit;
+    GLuint textures[gl_state_texture_units];
+    GLuint buffers[BUFFER_TARGETS];
+    int capabilities[CAPABILITIES]; // -1 unknown
+    int depth_write;                // -1 unknown
+    GLenum blend_source, blend_destination;
+    GLStateStats stats;
+
+    /// True if value has to be sent to GL, updates the shadow and the counters
+    template <typename T>
+    bool update(T &shadow, T value);
+    void activate_unit(unsigned unit);
+};
+
+/// Shadow of the one context the program draws with
+GLState &gl_state();
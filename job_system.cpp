@@ -0,0 +1,179 @@
+#include "job_system.hpp"
+#include <algorithm>
+
+// Queue index of the current thread, threads outside the system use the creating thread's queue
+static thread_local unsigned queue_index = 0;
+// Set while the current thread runs a background job, whatever it queues is background work as well
+static thread_local bool in_background = false;
+
+JobSystem::JobSystem(unsigned worker_count)
+{
+    for (unsigned i = 0; i <= worker_count; ++i)
+        queues.push_back(new Queue());
+    for (unsigned i = 1; i <= worker_count; ++i)
+        workers.emplace_back(&JobSystem::worker_loop, this, i);
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        running = false;
+    }
+    wake.notify_all();
+    for (std::thread &worker : workers)
+        worker.join();
+    for (Queue *queue : queues)
+        delete queue;
+}
+
+bool JobSystem::push(Queue &queue, const Job &job)
+{
+    if (workers.empty())
+        return false;
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.size == job_queue_capacity)
+        return false;
+    queue.jobs[(queue.front + queue.size++) % job_queue_capacity] = job;
+    queued.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+void JobSystem::run(const Job &job)
+{
+    if (in_background)
+    {
+        run_background(job);
+        return;
+    }
+
+    // No room or nobody to share with
+    if (!push(*queues[queue_index], job))
+    {
+        execute(job, false);
+        return;
+    }
+
+    // A worker that just found nothing is either still before its check or already waiting
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+    }
+    wake.notify_one();
+}
+
+void JobSystem::run_background(const Job &job)
+{
+    if (!push(background, job))
+    {
+        execute(job, true);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+    }
+    wake.notify_one();
+}
+
+bool JobSystem::pop(unsigned index, Job &job)
+{
+    Queue &queue = *queues[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.size == 0)
+        return false;
+    job = queue.jobs[(queue.front + --queue.size) % job_queue_capacity];
+    return true;
+}
+
+bool JobSystem::pop_background(Job &job)
+{
+    std::lock_guard<std::mutex> lock(background.mutex);
+    if (background.size == 0)
+        return false;
+    job = background.jobs[background.front];
+    background.front = (background.front + 1) % job_queue_capacity;
+    --background.size;
+    return true;
+}
+
+bool JobSystem::steal(unsigned thief, Job &job)
+{
+    for (unsigned offset = 1; offset < queues.size(); ++offset)
+    {
+        Queue &queue = *queues[(thief + offset) % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.size == 0)
+            continue;
+        job = queue.jobs[queue.front];
+        queue.front = (queue.front + 1) % job_queue_capacity;
+        --queue.size;
+        return true;
+    }
+    return false;
+}
+
+void JobSystem::execute(const Job &job, bool background)
+{
+    // Restored afterwards, a background job waiting for its children may run frame jobs in between
+    bool outer = in_background;
+    in_background = background;
+    job.function(job.data, job.begin, job.end);
+    in_background = outer;
+    job.counter->pending.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void JobSystem::wait(JobCounter &counter)
+{
+    Job job;
+    while (counter.pending.load(std::memory_order_acquire) > 0)
+    {
+        if (pop(queue_index, job) || steal(queue_index, job))
+        {
+            queued.fetch_sub(1, std::memory_order_relaxed);
+            execute(job, false);
+        }
+        // Only background jobs help with background work, their children are queued there
+        else if (in_background && pop_background(job))
+        {
+            queued.fetch_sub(1, std::memory_order_relaxed);
+            execute(job, true);
+        }
+        else
+            // The remaining jobs are running on other threads
+            std::this_thread::yield();
+    }
+}
+
+void JobSystem::worker_loop(unsigned index)
+{
+    queue_index = index;
+    Job job;
+    while (true)
+    {
+        // Frame work first, background jobs only when there is none
+        if (pop(index, job) || steal(index, job))
+        {
+            queued.fetch_sub(1, std::memory_order_relaxed);
+            execute(job, false);
+            continue;
+        }
+        if (pop_background(job))
+        {
+            queued.fetch_sub(1, std::memory_order_relaxed);
+            execute(job, true);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        wake.wait(lock, [this]
+                  { return !running || queued.load(std::memory_order_acquire) > 0; });
+        if (!running)
+            return;
+    }
+}
+
+JobSystem &job_system()
+{
+    static JobSystem system(std::max(1u, std::thread::hardware_concurrency()) - 1);
+    return system;
+}
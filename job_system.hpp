@@ -0,0 +1,98 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Jobs a worker queue holds at most, a full queue runs new jobs inline
+#define job_queue_capacity 4096
+
+/// Counts unfinished jobs of a batch, a job depending on the batch waits for it to reach zero
+struct JobCounter
+{
+    std::atomic<int> pending{0};
+};
+
+/// Processes items [begin, end) of the batch data points to
+typedef void (*JobFunction)(void *data, size_t begin, size_t end);
+
+struct Job
+{
+    JobFunction function;
+    void *data;
+    size_t begin, end;
+    JobCounter *counter;
+};
+
+/// Work-stealing job system. Every worker, and the thread that created the system, owns a queue:
+/// the owner pushes and pops at the back, idle threads steal the oldest jobs from the front.
+/// Jobs are plain function pointers with a data pointer, so scheduling never allocates.
+/// GL calls must stay out of jobs, only the creating thread has the context.
+class JobSystem
+{
+public:
+    /// worker_count threads are started next to the calling one, 0 runs everything inline
+    explicit JobSystem(unsigned worker_count);
+    ~JobSystem();
+    JobSystem(const JobSystem &) = delete;
+    JobSystem &operator=(const JobSystem &) = delete;
+
+    /// Queues job on the calling thread's queue, job.counter has to be incremented beforehand.
+    /// Called from a background job it queues a background job instead.
+    void run(const Job &job);
+    /// Queues a long running job, e.g. asset loading. Jobs it spawns, parallel_for chunks included,
+    /// are background jobs too. Only idle workers and background jobs waiting for their own children
+    /// pick these up, never a thread waiting for frame work, so they can't stall a frame.
+    void run_background(const Job &job);
+    /// Runs queued jobs until counter reaches zero, background ones only if called from a background job
+    void wait(JobCounter &counter);
+
+    /// Calls body(begin, end) on chunks of at most chunk_size items covering [0, count), returns once all are done
+    template <typename F>
+    void parallel_for(size_t count, size_t chunk_size, F &&body)
+    {
+        typedef typename std::remove_reference<F>::type Body;
+        JobCounter counter;
+        if (chunk_size == 0)
+            chunk_size = 1;
+        for (size_t begin = 0; begin < count; begin += chunk_size)
+        {
+            counter.pending.fetch_add(1, std::memory_order_relaxed);
+            run(Job{[](void *data, size_t begin, size_t end)
+                    { (*(Body *)data)(begin, end); },
+                    (void *)&body, begin, std::min(begin + chunk_size, count), &counter});
+        }
+        wait(counter);
+    }
+
+    unsigned get_thread_count() const { return queues.size(); }
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        Job jobs[job_queue_capacity];
+        size_t front = 0, size = 0;
+    };
+
+    std::vector<Queue *> queues; // 0 belongs to the creating thread
+    Queue background;
+    std::vector<std::thread> workers;
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+    std::atomic<int> queued{0};
+    std::atomic<bool> running{true};
+
+    void worker_loop(unsigned index);
+    bool pop(unsigned index, Job &job);
+    bool steal(unsigned thief, Job &job);
+    bool pop_background(Job &job);
+    bool push(Queue &queue, const Job &job);
+    /// Jobs queued while job runs are background jobs if it is one
+    void execute(const Job &job, bool background);
+};
+
+/// Shared by the whole program, one worker per core besides the main thread
+JobSystem &job_system();
@@ -9,52 +9,125 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
-// libassimp-dev
-#include <assimp/Importer.hpp>
-#include <assimp/scene.h>
-#include <assimp/postprocess.h>
-
 #include <math.h>
 #include <stdlib.h>
 #include <iostream>
 #include <stdio.h>
 #include <vector>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 #include "constants.hpp"
 #include "shaderprogram.h"
 #include "myCube.h"
 #include "mesh.h"
 #include "particle_system.hpp"
+#include "particle_manager.hpp"
+#include "job_system.hpp"
+#include "frame_uniforms.hpp"
+#include "ocean.hpp"
+#include "frame_arena.hpp"
+#include "triple_buffer.hpp"
+#include "spsc_queue.hpp"
+#include "asset_loader.hpp"
+#include "texture_cache.hpp"
+#include "render_queue.hpp"
+#include "gl_state.hpp"
 
 #define sky_color 0, 0.4f, 0.8f, 1
 #define water_color 0, 0.3f, 1, 1
 #define MAX_TIME 255
+// Print per-frame counters (heap allocations of the simulation and drawing threads, arena use) to stdout
+#define print_frame_stats 0
+// Simulate smoke with transform feedback instead of on the CPU
+#define gpu_particles 0
+// Draw smoke as camera-facing quads shaded like spheres instead of sphere meshes
+#define billboard_particles 1
+// Emission seed of the smoke, a fixed one repeats the same plume on every run
+#define smoke_seed 1
+// Simulate on a separate thread one frame ahead of drawing, 0 runs both in turn on the main thread
+#define threaded_simulation 1
 #define water_side_length 100
+// Ocean clipmap: level 0 spans 2 * 32 cells of 0.5 units, every next level doubles that
+#define ocean_extent 32
+#define ocean_spacing 0.5f
+#define ocean_levels 7
+// Radians per unit along x + z, one period spans ~40 units as on the old 100 vertex plane
+#define wave_number 0.1547f
 
-float speed_x = 0; //[radians/s]
-float speed_y = 0; //[radians/s]
 float wheel_speed = TAU / 8;
 
+// Key presses and releases on their way from key_callback to the simulation
+struct InputEvent
+{
+    int key, action;
+};
+SpscQueue<InputEvent, 64> input_events;
+
+// Owned by the simulation
+struct Simulation
+{
+    float speed_x = 0; //[radians/s]
+    float speed_y = 0; //[radians/s]
+    float angle_x = -PI / 6;
+    float angle_y = 0;
+    float wheel_angle = 0;
+    float time = 0;
+};
+
+// Everything drawScene needs for one frame, produced by the simulation
+struct FrameState
+{
+    FrameUniforms frame;
+    glm::mat4 root_model_matrix, wheel_model_matrix, water_model_matrix;
+    float wave_phase;
+    std::vector<ParticleSnapshot> particles;
+};
+TripleBuffer<FrameState> frame_states;
+// Drawing signals every frame it takes and the shutdown, the simulation sleeps on it while it is ahead
+std::mutex simulation_mutex;
+std::condition_variable simulation_wakeup;
+bool simulation_running = false; // Guarded by simulation_mutex
+unsigned long frames_taken = 0;  // Guarded by simulation_mutex
+
 const glm::vec4 light_position = glm::vec4(0, 6, 4, 1);
 
 std::vector<Mesh *> meshes;
+// Loads the scene in the background when there is no baked pack
+AssetLoader *asset_loader;
 
-bool load_scene(const char *path)
+// Loads a scene baked by bake.cpp, geometry and mip chains are uploaded straight from the mapping.
+// Returns false if the pack is missing, from another version or older than its sources.
+bool load_pack(const char *path)
 {
-    Assimp::Importer importer;
-    const aiScene *scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
-
-    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+    AssetPack pack;
+    if (!pack.open(path))
+        return false;
+    if (pack.is_stale())
     {
-        std::cout << "ERROR::ASSIMP::" << importer.GetErrorString() << std::endl;
+        std::cout << path << " is older than its sources, rebake it with bake.sh" << std::endl;
         return false;
     }
 
-    for (int i = 0; i < scene->mNumMeshes; ++i)
+    const PackHeader &header = pack.header();
+    for (uint32_t i = 0; i < header.mesh_count; ++i)
     {
-        aiMesh *mesh = scene->mMeshes[i];
-        meshes.push_back(new Mesh(mesh, scene));
+        const PackMesh &entry = pack.mesh(i);
+        Mesh *m = new Mesh();
+        m->name = entry.name;
+        m->has_texture_coordinates = entry.has_texture_coordinates;
+        // Every mesh holds its own cache reference, each texture is uploaded once
+        if (entry.diffuse_texture >= 0)
+            m->diffuse_texture = upload_packed_texture(pack, pack.texture(entry.diffuse_texture));
+        if (entry.roughness_texture >= 0)
+            m->roughness_texture = upload_packed_texture(pack, pack.texture(entry.roughness_texture));
+        m->upload_buffers((const PackedVertex *)pack.at(entry.vertices_offset), entry.vertex_count,
+                          (const uint32_t *)pack.at(entry.indices_offset), entry.index_count);
+        meshes.push_back(m);
     }
+    texture_cache().print_resident();
 
     return true;
 }
@@ -67,45 +140,6 @@ glm::mat4 rotate_around(glm::mat4 m, glm::vec3 pivot, float angle, glm::vec3 axi
     return m;
 }
 
-/// Generatez plane on XZ plane, centered at (0,0)
-Mesh *generate_plane(unsigned int n = 2, float min = -1, float max = 1)
-{
-    assert(n > 1);
-    Mesh *m = new Mesh();
-
-    m->vertex_positons.reserve(n * n);
-    m->vertex_normals.reserve(n * n);
-    m->faces.reserve((n - 1) * (n - 1));
-    m->has_texture_coordinates = true;
-    m->diffuse_texture = readTexture("water.png");
-    m->texture_coordinates = std::vector<glm::vec2>(n * n, glm::vec2(0.5f));
-
-    for (unsigned int x = 0; x < n; ++x)
-    {
-        if (x != (n - 1))
-            for (unsigned int z = 0; z < n; ++z)
-            {
-                m->vertex_positons.push_back(glm::vec4(min + (float)x / (n - 1) * (max - min), 0, min + (float)z / (n - 1) * (max - min), 1));
-                if (z != (n - 1))
-                {
-                    unsigned int index = x * n + z;
-                    m->faces.push_back(glm::ivec3(index, index + 1, index + n));
-                    m->faces.push_back(glm::ivec3(index + 1, index + n + 1, index + n));
-                }
-            }
-        else
-            for (unsigned int z = 0; z < n; ++z)
-            {
-                m->vertex_positons.push_back(glm::vec4(min + (float)x / (n - 1) * (max - min), 0, min + (float)z / (n - 1) * (max - min), 1));
-            }
-    }
-    m->vertex_normals = std::vector<glm::vec4>(m->faces.size() * 3, glm::vec4(0, 1, 0, 0));
-    m->name = "plane";
-    m->initialize_draw_vertices();
-    m->initialize_draw_texture_coordinates();
-    return m;
-}
-
 Mesh *generate_uvsphere(int segments_x, int segments_y, float radius)
 {
     assert(segments_x > 2);
@@ -169,7 +203,30 @@ Mesh *generate_uvsphere(int segments_x, int segments_y, float radius)
     }
 
     m->name = "uvsphere";
-    m->initialize_draw_vertices();
+    m->optimize();
+    m->initialize_buffers();
+    return m;
+}
+
+// Quad facing +Z with corners at +-half_size, expanded towards the camera in the particle shader
+Mesh *generate_billboard(float half_size)
+{
+    Mesh *m = new Mesh();
+    m->vertex_positons = {
+        glm::vec4(-half_size, -half_size, 0, 1),
+        glm::vec4(half_size, -half_size, 0, 1),
+        glm::vec4(half_size, half_size, 0, 1),
+        glm::vec4(-half_size, half_size, 0, 1)};
+    m->vertex_normals = std::vector<glm::vec4>(4, glm::vec4(0, 0, 1, 0));
+    m->has_texture_coordinates = true;
+    m->texture_coordinates = {glm::vec2(0, 0), glm::vec2(1, 0), glm::vec2(1, 1), glm::vec2(0, 1)};
+    // Shaded procedurally
+    m->diffuse_texture = 0;
+    m->faces = {glm::ivec3(0, 1, 2), glm::ivec3(0, 2, 3)};
+
+    m->name = "billboard";
+    m->optimize();
+    m->initialize_buffers();
     return m;
 }
 
@@ -186,41 +243,50 @@ void key_callback(
     int action,
     int mod)
 {
-    if (action == GLFW_PRESS)
+    // A full queue drops the event, it holds far more than a frame's worth of key presses
+    input_events.push(InputEvent{key, action});
+}
+
+void apply_input(const InputEvent &event, Simulation &sim)
+{
+    if (event.action == GLFW_PRESS)
     {
-        if (key == GLFW_KEY_LEFT)
+        if (event.key == GLFW_KEY_LEFT)
         {
-            speed_y = -PI;
+            sim.speed_y = -PI;
         }
-        if (key == GLFW_KEY_RIGHT)
+        if (event.key == GLFW_KEY_RIGHT)
         {
-            speed_y = PI;
+            sim.speed_y = PI;
         }
-        if (key == GLFW_KEY_UP)
+        if (event.key == GLFW_KEY_UP)
         {
-            speed_x = -PI;
+            sim.speed_x = -PI;
         }
-        if (key == GLFW_KEY_DOWN)
+        if (event.key == GLFW_KEY_DOWN)
         {
-            speed_x = PI;
+            sim.speed_x = PI;
         }
     }
-    if (action == GLFW_RELEASE)
+    if (event.action == GLFW_RELEASE)
     {
-        if (key == GLFW_KEY_LEFT || key == GLFW_KEY_RIGHT)
+        if (event.key == GLFW_KEY_LEFT || event.key == GLFW_KEY_RIGHT)
         {
-            speed_y = 0;
+            sim.speed_y = 0;
         }
-        if (key == GLFW_KEY_UP || key == GLFW_KEY_DOWN)
+        if (event.key == GLFW_KEY_UP || event.key == GLFW_KEY_DOWN)
         {
-            speed_x = 0;
+            sim.speed_x = 0;
         }
     }
 }
 
-ShaderProgram *Chimney, *LambertTextured, *Water, *Smoke;
-Mesh *plane, *uv_sphere;
-ParticleSystem *smoke;
+ShaderProgram *Chimney, *LambertTextured, *Water, *Smoke, *ParticleUpdate;
+Mesh *uv_sphere, *billboard;
+Ocean *ocean;
+FrameUniformBuffer *frame_uniforms;
+ParticleSystem *smoke; // Owned by particles
+ParticleManager *particles;
 
 // Initialization code procedure
 void initOpenGLProgram(GLFWwindow *window)
@@ -229,13 +295,19 @@ void initOpenGLProgram(GLFWwindow *window)
     Chimney = new ShaderProgram("v_chimney.glsl", "f_chimney.glsl");
     LambertTextured = new ShaderProgram("v_lamberttextured.glsl", "f_lamberttextured.glsl");
     Water = new ShaderProgram("v_water.glsl", "f_water.glsl");
+#if billboard_particles
+    Smoke = new ShaderProgram("v_billboard.glsl", "f_billboard.glsl");
+#else
     Smoke = new ShaderProgram("v_smoke.glsl", "f_smoke.glsl");
-    plane = generate_plane(water_side_length, -32, 32);
+#endif
+    frame_uniforms = new FrameUniformBuffer();
+    ocean = new Ocean(ocean_extent, ocean_spacing, ocean_levels, readTexture("water.png"));
     uv_sphere = generate_uvsphere(12, 6, 0.3);
+    billboard = generate_billboard(0.3);
     smoke = new ParticleSystem(
         glm::vec4(3.3f, 8, 0.f, 1),
         glm::vec3(0.1),
-        100.f,
+        400.f,
         glm::vec4(0, 1, 0, 0),
         PI / 6,
         1.2f,
@@ -243,74 +315,125 @@ void initOpenGLProgram(GLFWwindow *window)
         0.05f,
         5.f,
         1.f,
+#if billboard_particles
+        billboard,
+#else
         uv_sphere,
-        Smoke);
+#endif
+        Smoke,
+        4096);
+    smoke->seed(smoke_seed);
+#if gpu_particles
+    const char *particle_state[] = {"outPosition", "outLifetime", "outVelocity"};
+    ParticleUpdate = new ShaderProgram("v_particle_update.glsl", particle_state, 3);
+    smoke->enable_gpu_simulation(ParticleUpdate);
+#else
+    ParticleUpdate = nullptr;
+#endif
+    particles = new ParticleManager();
+    particles->add(smoke);
     glClearColor(sky_color); // Set color buffer clear color
-    glEnable(GL_DEPTH_TEST); // Turn on pixel depth test based on depth buffer
+    gl_state().set_enabled(GL_DEPTH_TEST, true); // Turn on pixel depth test based on depth buffer
     glfwSetKeyCallback(window, key_callback);
-    load_scene("statek.obj");
+    asset_loader = new AssetLoader();
+    if (!load_pack("statek.pack"))
+        asset_loader->load_scene("statek.obj", meshes);
 }
 
 // Release resources allocated by the program
 void freeOpenGLProgram(GLFWwindow *window)
 {
     //************Place any code here that needs to be executed once, after the main loop ends************
-    delete Chimney, LambertTextured, Water, Smoke;
+    delete Chimney;
+    delete LambertTextured;
+    delete Water;
+    delete Smoke;
+    delete ParticleUpdate;
     for (Mesh *m : meshes)
     {
         delete m;
     }
     meshes.clear();
-    delete plane, uv_sphere, smoke;
+    delete asset_loader;
+    delete frame_uniforms;
+    delete ocean;
+    delete uv_sphere;
+    delete particles;
+    delete billboard;
 }
 
-void drawWater(ShaderProgram *shader, glm::mat4 P, glm::mat4 V, glm::mat4 M, float phase)
+unsigned drawWater(ShaderProgram *shader, const FrameUniforms &frame, glm::mat4 M, float phase)
 {
+    shader->use();
+    glUniform1f(shader->getUniformLocation(UNIFORM_WAVE_PHASE), phase);
+    glUniform1f(shader->getUniformLocation(UNIFORM_WAVE_NUMBER), wave_number);
+    return ocean->draw(shader, frame, M);
+}
 
-    std::vector<glm::vec4> colors = std::vector<glm::vec4>(plane->faces.size() * 3, glm::vec4(water_color)),
-                           offsets = std::vector<glm::vec4>(plane->faces.size() * 3),
-                           face_normals = std::vector<glm::vec4>(plane->faces.size()),
-                           vertex_normals = std::vector<glm::vec4>(plane->faces.size() * 3);
+// Render queue callbacks for what isn't a single mesh draw
+struct WaterItem
+{
+    const FrameUniforms *frame;
+    glm::mat4 M;
+    float phase;
+};
 
-    const float size = 10;
-    int j = 0, face_index = 0;
-    for (const auto &face : plane->faces)
-    {
-        for (int i = 0; i < 3; ++i)
-        {
-            auto index = face[i];
-            int x = index % water_side_length, y = index / water_side_length;
-            offsets[j] = glm::vec4(0, (sin((x + y) / size + phase)), 0, 0);
-            ++j;
-        }
-        face_normals[face_index++] = glm::normalize(glm::vec4(glm::cross(
-                                                                  glm::vec3((plane->vertex_positons[face[0]] + offsets[j - 3]) - (plane->vertex_positons[face[2]] + offsets[j - 1])),
-                                                                  glm::vec3((plane->vertex_positons[face[1]] + offsets[j - 2]) - (plane->vertex_positons[face[2]] + offsets[j - 1]))),
-                                                              0));
-    }
+unsigned draw_water_item(void *data)
+{
+    const WaterItem &water = *(const WaterItem *)data;
+    return drawWater(Water, *water.frame, water.M, water.phase);
+}
 
-    for (int i = 0; i < face_normals.size(); ++i)
-        vertex_normals[3 * i] = vertex_normals[3 * i + 1] = vertex_normals[3 * i + 2] = face_normals[i];
+struct ParticleItem
+{
+    const FrameUniforms *frame;
+    const std::vector<ParticleSnapshot> *snapshots;
+    const Frustum *frustum;
+    CullStats stats;
+};
 
-    shader->use();
-    glUniform4f(shader->getUniformLocation("lightPosition"), light_position.x, light_position.y, light_position.z, light_position.w);
-    glEnableVertexAttribArray(shader->getAttributeLocation("colors"));
-    glEnableVertexAttribArray(shader->getAttributeLocation("normals"));
-    glEnableVertexAttribArray(shader->getAttributeLocation("offset"));
-    glVertexAttribPointer(shader->getAttributeLocation("colors"), 4, GL_FLOAT, false, 0, colors.data());
-    glVertexAttribPointer(shader->getAttributeLocation("normals"), 4, GL_FLOAT, false, 0, vertex_normals.data());
-    glVertexAttribPointer(shader->getAttributeLocation("offset"), 4, GL_FLOAT, false, 0, offsets.data());
-    plane->drawTextured(shader, P, V, M);
-    glDisableVertexAttribArray(shader->getAttributeLocation("colors"));
-    glDisableVertexAttribArray(shader->getAttributeLocation("normals"));
-    glDisableVertexAttribArray(shader->getAttributeLocation("offset"));
+unsigned draw_particles_item(void *data)
+{
+    ParticleItem &item = *(ParticleItem *)data;
+#if billboard_particles
+    // Fading smoke, drawn last without writing depth so particles don't hide each other
+    gl_state().set_enabled(GL_BLEND, true);
+    gl_state().blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    gl_state().depth_mask(false);
+#endif
+    item.stats = particles->draw(*item.frame, *item.snapshots, *item.frustum);
+#if billboard_particles
+    gl_state().depth_mask(true);
+    gl_state().set_enabled(GL_BLEND, false);
+#endif
+    return item.stats.visible;
 }
 
-// Drawing procedure
-void drawScene(GLFWwindow *window, float angle_x, float angle_y, float wheel_angle, float time, float deltaTime)
+// Advances the scene by deltaTime and writes what drawing it takes into state.
+// No GL calls, this runs on the simulation thread.
+void step_simulation(Simulation &sim, FrameState &state, float deltaTime)
 {
-    //************Place any code here that draws something inside the window******************l
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // Clear color and depth buffers
+#if print_frame_stats
+    const unsigned long heap_allocations = heap_allocation_count();
+#endif
+    InputEvent event;
+    while (input_events.pop(event))
+        apply_input(event, sim);
+
+    const float max_angle_x = PI / 2 - 0.2;
+    sim.angle_x += sim.speed_x * deltaTime; // Compute an angle by which the object was rotated during the previous frame
+    sim.angle_x = glm::clamp(sim.angle_x, -max_angle_x, max_angle_x);
+    sim.angle_y = sim.angle_y + sim.speed_y * deltaTime; // Compute an angle by which the object was rotated during the previous frame
+    if (sim.angle_y > TAU)
+        sim.angle_y -= TAU;
+    else if (sim.angle_y < -TAU)
+        sim.angle_y += TAU;
+    sim.wheel_angle += wheel_speed * deltaTime;
+    if (sim.wheel_angle > TAU)
+        sim.wheel_angle -= TAU;
+    sim.time += deltaTime;
+    if (sim.time > MAX_TIME)
+        sim.time -= MAX_TIME;
 
     glm::mat4 root_model_matrix = glm::mat4(1.0f);
     glm::vec3 camera_position = glm::vec4(0, 30, 0, 0),
@@ -319,42 +442,154 @@ void drawScene(GLFWwindow *window, float angle_x, float angle_y, float wheel_ang
               right = glm::vec3(0, 0, 1),
               camera_to_focus = (camera_position - focus_point),
               direction = glm::normalize(camera_to_focus);
-    glm::mat4 camera_model_matrix = glm::rotate(root_model_matrix, angle_x, glm::vec3(0.0f, 0.0f, 1.0f));
-    camera_model_matrix = glm::rotate(camera_model_matrix, angle_y, glm::vec3(0.0f, 1.0f, 0.0f));
-    glm::mat4 V = glm::lookAt(glm::vec3(glm::vec4(camera_to_focus, 1) * camera_model_matrix) + focus_point, focus_point, up);
-    glm::mat4 P = glm::perspective(glm::radians(50.0f), 1.0f, 1.0f, 100.0f);
+    glm::mat4 camera_model_matrix = glm::rotate(root_model_matrix, sim.angle_x, glm::vec3(0.0f, 0.0f, 1.0f));
+    camera_model_matrix = glm::rotate(camera_model_matrix, sim.angle_y, glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::vec3 eye = glm::vec3(glm::vec4(camera_to_focus, 1) * camera_model_matrix) + focus_point;
+    glm::mat4 V = glm::lookAt(eye, focus_point, up);
+    glm::mat4 P = glm::perspective(glm::radians(50.0f), 1.0f, 1.0f, 2000.0f);
 
-    glm::mat4 water_model_matrix = glm::translate(
+    state.water_model_matrix = glm::translate(
         root_model_matrix,
         glm::vec3(0, 0.25f, 0));
 
     const glm::vec4 redLightSource = smoke->get_origin();
     static const float frequency = 0.5;
-    float phase = frequency * time;
-    root_model_matrix = glm::translate(root_model_matrix, glm::vec3(0, sin(water_side_length - phase) - 0.4, 0));
-    drawWater(Water, P, V, water_model_matrix, phase);
-    for (Mesh *m : meshes)
+    state.wave_phase = frequency * sim.time;
+    const float bob = sin(water_side_length - state.wave_phase) - 0.4;
+    root_model_matrix = glm::translate(root_model_matrix, glm::vec3(0, bob, 0));
+    state.root_model_matrix = root_model_matrix;
+    state.wheel_model_matrix = rotate_around(root_model_matrix, glm::vec3(-4.7, 0, 0), sim.wheel_angle, glm::vec3(0, 0, 1));
+
+    FrameUniforms &frame = state.frame;
+    frame.P = P;
+    frame.V = V;
+    frame.VP = P * V;
+    frame.camera_position = glm::vec4(eye, 1);
+    frame.light_position = light_position;
+    frame.red_light_source = glm::vec4(redLightSource.x, redLightSource.y - 0.1 + bob, redLightSource.z, redLightSource.w);
+
+#if !gpu_particles
+    particles->update(deltaTime, frame, root_model_matrix);
+    particles->write_snapshots(state.particles);
+#if print_frame_stats
+    particles->print_budgets();
+#endif
+#endif
+#if print_frame_stats
+    printf("simulation heap allocations: %lu\n", heap_allocation_count() - heap_allocations);
+#endif
+}
+
+// Takes the latest simulated frame for drawing, which lets the simulation start on the next one
+bool acquire_frame()
+{
+    if (!frame_states.acquire())
+        return false;
+    {
+        std::lock_guard<std::mutex> lock(simulation_mutex);
+        ++frames_taken;
+    }
+    simulation_wakeup.notify_one();
+    return true;
+}
+
+// Produces frames until stopped. The next frame is simulated while the last one is drawn, but only once
+// drawing has taken it, so no published frame is overwritten unseen.
+void simulation_loop()
+{
+    Simulation sim;
+    unsigned long produced = 0;
+    auto last = std::chrono::steady_clock::now();
+    while (true)
     {
-        if (m->name == "kolo")
         {
-            glm::mat4 wheel_model_matrix = root_model_matrix;
-            wheel_model_matrix = rotate_around(wheel_model_matrix, glm::vec3(-4.7, 0, 0), wheel_angle, glm::vec3(0, 0, 1));
-            m->drawTexturedShaded(LambertTextured, P, V, wheel_model_matrix, light_position);
+            std::unique_lock<std::mutex> lock(simulation_mutex);
+            simulation_wakeup.wait(lock, [&]
+                                   { return !simulation_running || produced <= frames_taken; });
+            if (!simulation_running)
+                break;
         }
+
+        auto now = std::chrono::steady_clock::now();
+        float deltaTime = std::chrono::duration<float>(now - last).count();
+        last = now;
+        step_simulation(sim, frame_states.write_buffer(), deltaTime);
+        frame_states.publish();
+        ++produced;
+    }
+}
+
+// Drawing procedure
+void drawScene(GLFWwindow *window, const FrameState &state, float deltaTime)
+{
+    //************Place any code here that draws something inside the window******************l
+    frame_arena().reset();
+#if print_frame_stats
+    const unsigned long heap_allocations = heap_allocation_count();
+    gl_state().reset_stats();
+#endif
+
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // Clear color and depth buffers
+
+    const FrameUniforms &frame = state.frame;
+    frame_uniforms->update(frame);
+
+    const std::vector<ParticleSnapshot> *particle_snapshots = &state.particles;
+#if gpu_particles
+    // Transform feedback needs the context, the GPU backend is simulated here at the drawing rate
+    static std::vector<ParticleSnapshot> gpu_particle_snapshots;
+    particles->update(deltaTime, frame, state.root_model_matrix);
+    particles->write_snapshots(gpu_particle_snapshots);
+    particle_snapshots = &gpu_particle_snapshots;
+#if print_frame_stats
+    particles->print_budgets();
+#endif
+#else
+    (void)deltaTime; // CPU particles are simulated with the rest of the scene
+#endif
+
+    const Frustum frustum(frame.VP);
+    FrustumCuller mesh_culler(meshes.size());
+    float *mesh_depths = (float *)frame_arena().allocate(meshes.size() * sizeof(float), alignof(float));
+    for (size_t i = 0; i < meshes.size(); ++i)
+    {
+        Mesh *m = meshes[i];
+        Bounds bounds = transform_bounds(m->bounds, m->name == "kolo" ? state.wheel_model_matrix : state.root_model_matrix);
+        mesh_culler.add(bounds);
+        mesh_depths[i] = -(frame.V * glm::vec4(bounds.center, 1)).z;
+    }
+    mesh_culler.cull(frustum);
+
+    RenderQueue queue(meshes.size() + 2, frame);
+    for (size_t i = 0; i < meshes.size(); ++i)
+    {
+        Mesh *m = meshes[i];
+        if (!mesh_culler.is_visible(i))
+            continue;
+        if (m->name == "kolo")
+            queue.add_mesh(RENDER_OPAQUE, m, LambertTextured, state.wheel_model_matrix, mesh_depths[i]);
         else if (m->name == "komin")
-        {
-            Chimney->use();
-            glUniform4f(Chimney->getUniformLocation("redLightSource"), redLightSource.x, redLightSource.y - 0.1 + sin(water_side_length - phase) - 0.4, redLightSource.z, redLightSource.w);
-            m->drawTexturedShaded(Chimney, P, V, root_model_matrix, light_position);
-        }
+            queue.add_mesh(RENDER_OPAQUE, m, Chimney, state.root_model_matrix, mesh_depths[i]);
         else
-            m->drawTexturedShaded(LambertTextured, P, V, root_model_matrix, light_position);
-        // m->draw(Chimney, P, V, root_model_matrix);
+            queue.add_mesh(RENDER_OPAQUE, m, LambertTextured, state.root_model_matrix, mesh_depths[i]);
     }
-
-    smoke->shader->use();
-    glUniform4f(smoke->shader->getUniformLocation("lightSource"), redLightSource.x, redLightSource.y - 0.1 + sin(water_side_length - phase) - 0.4, redLightSource.z, redLightSource.w);
-    smoke->draw(deltaTime, P, V, root_model_matrix);
+    // The clipmap is centered on the camera, some of it is always in view
+    WaterItem water{&frame, state.water_model_matrix, state.wave_phase};
+    queue.add_callback(RENDER_WATER, draw_water_item, &water);
+    ParticleItem smoke_item{&frame, particle_snapshots, &frustum, CullStats()};
+    queue.add_callback(RENDER_TRANSPARENT, draw_particles_item, &smoke_item);
+    queue.submit();
+
+#if print_frame_stats
+    printf("draw heap allocations: %lu, frame arena: %zu/%zu bytes\n", heap_allocation_count() - heap_allocations, frame_arena().get_used(), frame_arena().get_capacity());
+    const CullStats mesh_stats = mesh_culler.get_stats();
+    printf("visible meshes: %zu/%zu, emitters: %zu/%zu\n", mesh_stats.visible, mesh_stats.tested, smoke_item.stats.visible, smoke_item.stats.tested);
+    const RenderStats render_stats = queue.get_stats();
+    printf("draw calls: %zu, program changes: %zu, texture changes: %zu, vertex array changes: %zu\n", render_stats.draw_calls,
+           render_stats.program_changes, render_stats.texture_changes, render_stats.vertex_array_changes);
+    const GLStateStats state_stats = gl_state().get_stats();
+    printf("GL state calls: %zu issued, %zu filtered\n", state_stats.issued, state_stats.filtered);
+#endif
 
     glfwSwapBuffers(window); // Copy back buffer to the front buffer
 }
@@ -393,33 +628,41 @@ int main(void)
     initOpenGLProgram(window); // Call initialization procedure
 
     // Main application loop
-    float angle_x = -PI / 6; // declare variable for storing current rotation angle
-    float angle_y = 0;       // declare variable for storing current rotation angle
-    float wheel_angle = 0;
-    float time = 0;
     float deltaTime = 0;
-    const float max_angle_x = PI / 2 - 0.2;
+#if threaded_simulation
+    simulation_running = true;
+    std::thread simulation_thread(simulation_loop);
+    // Nothing to draw before the first frame
+    while (!acquire_frame())
+        std::this_thread::yield();
+#else
+    Simulation sim;
+#endif
     glfwSetTime(0);                        // clear internal timer
     while (!glfwWindowShouldClose(window)) // As long as the window shouldnt be closed yet...
     {
         deltaTime = glfwGetTime();
-        angle_x += speed_x * deltaTime; // Compute an angle by which the object was rotated during the previous frame
-        angle_x = glm::clamp(angle_x, -max_angle_x, max_angle_x);
-        angle_y = angle_y + speed_y * deltaTime; // Compute an angle by which the object was rotated during the previous frame
-        if (angle_y > TAU)
-            angle_y -= TAU;
-        else if (angle_y < -TAU)
-            angle_y += TAU;
-        wheel_angle += wheel_speed * deltaTime;
-        if (wheel_angle > TAU)
-            wheel_angle -= TAU;
-        time += deltaTime;
-        if (time > MAX_TIME)
-            time -= MAX_TIME;
-        glfwSetTime(0);                                                    // clear internal timer
-        drawScene(window, angle_x, angle_y, wheel_angle, time, deltaTime); // Execute drawing procedure
-        glfwPollEvents();                                                  // Process callback procedures corresponding to the events that took place up to now
+        glfwSetTime(0); // clear internal timer
+#if threaded_simulation
+        // Without a new frame the last one is drawn again
+        acquire_frame();
+#else
+        step_simulation(sim, frame_states.write_buffer(), deltaTime);
+        frame_states.publish();
+        frame_states.acquire();
+#endif
+        asset_loader->process_uploads();
+        drawScene(window, frame_states.read_buffer(), deltaTime); // Execute drawing procedure
+        glfwPollEvents(); // Process callback procedures corresponding to the events that took place up to now
+    }
+#if threaded_simulation
+    {
+        std::lock_guard<std::mutex> lock(simulation_mutex);
+        simulation_running = false;
     }
+    simulation_wakeup.notify_one();
+    simulation_thread.join();
+#endif
     freeOpenGLProgram(window);
 
     glfwDestroyWindow(window); // Delete OpenGL context and the window.
@@ -1,7 +1,12 @@
 #include "mesh.h"
+#include "mesh_optimizer.hpp"
+#include "texture_cache.hpp"
+#include "gl_state.hpp"
 #include <iostream>
-// liblodepng-dev
-#include <lodepng.h>
+#include <cstdio>
+#include <cmath>
+#include <cstddef>
+#include <string>
 #include <glm/gtc/type_ptr.hpp>
 
 #define small_texture 0
@@ -41,26 +46,23 @@ Mesh::Mesh(aiMesh *mesh, const aiScene *scene)
         aiMaterial *mat = scene->mMaterials[mesh->mMaterialIndex];
         if (mat->GetTextureCount(aiTextureType_DIFFUSE) > 0 && mat->GetTexture(aiTextureType_DIFFUSE, 0, &path) == AI_SUCCESS)
         {
-            diffuse_texture = readTexture(path.C_Str());
-            // std::cout << "Diffuse: " << path.C_Str() << " ID " << diffuse_texture << std::endl;
+            diffuse_path = path.C_Str();
+            // std::cout << "Diffuse: " << path.C_Str() << std::endl;
         }
         if (mat->GetTextureCount(aiTextureType_SHININESS) > 0 && mat->GetTexture(aiTextureType_SHININESS, 0, &path) == AI_SUCCESS)
         {
             // std::cout << "Roughness: " << path.C_Str() << std::endl;
-            roughness_texture = readTexture(path.C_Str());
+            roughness_path = path.C_Str();
         }
     }
-
-    initialize_draw_vertices();
-    initialize_draw_texture_coordinates();
 }
 
-void Mesh::draw(ShaderProgram *sp, glm::mat4 P, glm::mat4 V, glm::mat4 M)
+void Mesh::draw(ShaderProgram *sp, const FrameUniforms &frame, glm::mat4 M)
 {
     // static bool t = false;
     // if (!t)
     // {
-    //     for (const auto &v : draw_vertices)
+    //     for (const auto &v : vertex_positons)
     //     {
     //         std::cout << v.x << " " << v.y << " " << v.z << std::endl;
     //     }
@@ -70,142 +72,99 @@ void Mesh::draw(ShaderProgram *sp, glm::mat4 P, glm::mat4 V, glm::mat4 M)
 
     sp->use();
 
-    glUniformMatrix4fv(sp->getUniformLocation("P"), 1, false, glm::value_ptr(P));
-    glUniformMatrix4fv(sp->getUniformLocation("V"), 1, false, glm::value_ptr(V));
-    glUniformMatrix4fv(sp->getUniformLocation("M"), 1, false, glm::value_ptr(M));
-
-    glEnableVertexAttribArray(sp->getAttributeLocation("vertex"));
-    // Vector >>> array
-    glVertexAttribPointer(sp->getAttributeLocation("vertex"), 4, GL_FLOAT, false, 0, draw_vertices.data());
-
-    glDrawArrays(GL_TRIANGLES, 0, draw_vertices.size());
+    upload_model_transforms(sp, frame, M);
 
-    glDisableVertexAttribArray(sp->getAttributeLocation("vertex"));
+    gl_state().bind_vertex_array(vertex_array);
+    glDrawElements(GL_TRIANGLES, index_count, GL_UNSIGNED_INT, nullptr);
 }
 
-void Mesh::drawTextured(ShaderProgram *sp, glm::mat4 P, glm::mat4 V, glm::mat4 M)
+void Mesh::draw_bound(ShaderProgram *sp, const FrameUniforms &frame, const glm::mat4 &M)
 {
-    sp->use();
-
-    glUniformMatrix4fv(sp->getUniformLocation("P"), 1, false, glm::value_ptr(P));
-    glUniformMatrix4fv(sp->getUniformLocation("V"), 1, false, glm::value_ptr(V));
-    glUniformMatrix4fv(sp->getUniformLocation("M"), 1, false, glm::value_ptr(M));
-
-    glEnableVertexAttribArray(sp->getAttributeLocation("vertex"));
-    // Vector >>> array
-    glVertexAttribPointer(sp->getAttributeLocation("vertex"), 4, GL_FLOAT, false, 0, draw_vertices.data());
-
-    glEnableVertexAttribArray(sp->getAttributeLocation("texCoord"));
-    glVertexAttribPointer(sp->getAttributeLocation("texCoord"), 2, GL_FLOAT, false, 0, draw_texture_coordinates.data());
-
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, diffuse_texture);
-    glUniform1i(sp->getUniformLocation("tex"), 0);
-
-    glDrawArrays(GL_TRIANGLES, 0, draw_vertices.size());
-
-    glDisableVertexAttribArray(sp->getAttributeLocation("vertex"));
-    glDisableVertexAttribArray(sp->getAttributeLocation("texCoord"));
+    upload_model_transforms(sp, frame, M);
+    glDrawElements(GL_TRIANGLES, index_count, GL_UNSIGNED_INT, nullptr);
 }
 
-void Mesh::drawTexturedShaded(ShaderProgram *sp, glm::mat4 P, glm::mat4 V, glm::mat4 M, glm::vec4 light_position)
+GLuint readTexture(const char *filename)
 {
-    sp->use();
-
-    glUniform4f(sp->getUniformLocation("lightPosition"), light_position.x, light_position.y, light_position.z, light_position.w);
-    glUniformMatrix4fv(sp->getUniformLocation("P"), 1, false, glm::value_ptr(P));
-    glUniformMatrix4fv(sp->getUniformLocation("V"), 1, false, glm::value_ptr(V));
-    glUniformMatrix4fv(sp->getUniformLocation("M"), 1, false, glm::value_ptr(M));
-
-    glEnableVertexAttribArray(sp->getAttributeLocation("vertex"));
-    // Vector >>> array
-    glVertexAttribPointer(sp->getAttributeLocation("vertex"), 4, GL_FLOAT, false, 0, draw_vertices.data());
+#if small_texture == 1
+    filename = "bricks.png";
+#endif
+    return texture_cache().acquire(filename);
+}
 
-    glEnableVertexAttribArray(sp->getAttributeLocation("texCoord"));
-    glVertexAttribPointer(sp->getAttributeLocation("texCoord"), 2, GL_FLOAT, false, 0, draw_texture_coordinates.data());
+GLuint upload_packed_texture(const AssetPack &pack, const PackTexture &texture)
+{
+    // The bake keeps a single channel copy of images that are also used for color, it needs its own cache entry
+    std::string path = texture.path;
+    if (texture.format == TEXTURE_BC4)
+        path += "#r";
+    if (GLuint cached = texture_cache().find(path))
+        return cached;
+    return texture_cache().insert(path, TextureSampler(), (TextureFormat)texture.format, texture.width, texture.height, texture.levels,
+                                  (const unsigned char *)pack.at(texture.offset));
+}
 
-    glEnableVertexAttribArray(sp->getAttributeLocation("normal"));
-    glVertexAttribPointer(sp->getAttributeLocation("normal"), 4, GL_FLOAT, false, 0, draw_normals.data());
+void Mesh::optimize()
+{
+    if (!has_texture_coordinates)
+        texture_coordinates = {};
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, diffuse_texture);
-    glUniform1i(sp->getUniformLocation("tex"), 0);
+    const float acmr_before = average_cache_miss_ratio(faces, vertex_positons.size());
+    const unsigned int vertices_before = vertex_positons.size();
 
-#if small_texture == 0
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, roughness_texture);
-    glUniform1i(sp->getUniformLocation("rough"), 1);
-#endif
+    optimize_mesh(vertex_positons, vertex_normals, texture_coordinates, faces);
 
-    glDrawArrays(GL_TRIANGLES, 0, draw_vertices.size());
+    // One call per line, meshes are optimized on several job threads at once
+    printf("Mesh %s: %u -> %zu vertices, ACMR %.3f -> %.3f\n", name.c_str(), vertices_before, vertex_positons.size(),
+           acmr_before, average_cache_miss_ratio(faces, vertex_positons.size()));
+}
 
-    glDisableVertexAttribArray(sp->getAttributeLocation("vertex"));
-    glDisableVertexAttribArray(sp->getAttributeLocation("texCoord"));
-    glDisableVertexAttribArray(sp->getAttributeLocation("normal"));
+void Mesh::initialize_buffers()
+{
+    std::vector<PackedVertex> packed = pack_vertices(vertex_positons, vertex_normals, has_texture_coordinates ? texture_coordinates : std::vector<glm::vec2>());
+    upload_buffers(packed.data(), packed.size(), (const uint32_t *)faces.data(), faces.size() * 3);
 }
 
-GLuint readTexture(const char *filename)
+void Mesh::upload_buffers(const PackedVertex *vertices, size_t vertex_count, const uint32_t *indices, size_t index_count)
 {
-    GLuint tex;
-    glActiveTexture(GL_TEXTURE0);
-
-    // Read into computers memory
-    std::vector<unsigned char> image; // Allocate memory
-    unsigned width, height;           // Variables for image size
-    // Read the image
-    unsigned error = lodepng::decode(image, width, height,
-#if small_texture == 1
-                                     "bricks.png"
-#else
-                                     filename
-#endif
-    );
-    if (error)
-        std::cout << "LODEPNG ERROR " << error << std::endl;
+    this->index_count = index_count;
+    bounds = compute_bounds(&vertices->position, vertex_count, sizeof(PackedVertex));
 
-    // Import to graphics card memory
-    glGenTextures(1, &tex);            // Initialize one handle
-    glBindTexture(GL_TEXTURE_2D, tex); // Activate handle
-    // Copy image to graphics cards memory reprezented by the active handle
-    glTexImage2D(GL_TEXTURE_2D, 0, 4, width, height, 0,
-                 GL_RGBA, GL_UNSIGNED_BYTE, (unsigned char *)image.data());
+    // Vertex array first, binding the index buffer would otherwise change whichever one a draw left bound
+    glGenVertexArrays(1, &vertex_array);
+    gl_state().bind_vertex_array(vertex_array);
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glGenBuffers(1, &vertex_buffer);
+    gl_state().bind_buffer(GL_ARRAY_BUFFER, vertex_buffer);
+    glBufferData(GL_ARRAY_BUFFER, vertex_count * sizeof(PackedVertex), vertices, GL_STATIC_DRAW);
 
-    return tex;
-}
+    glGenBuffers(1, &index_buffer);
+    gl_state().bind_buffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_count * sizeof(uint32_t), indices, GL_STATIC_DRAW);
 
-void Mesh::initialize_draw_vertices()
-{
-    draw_vertices = {};
-    draw_normals = {};
-    for (auto const &face : faces)
-    {
-        draw_vertices.push_back(vertex_positons[face[0]]);
-        draw_vertices.push_back(vertex_positons[face[1]]);
-        draw_vertices.push_back(vertex_positons[face[2]]);
-        draw_normals.push_back(vertex_normals[face[0]]);
-        draw_normals.push_back(vertex_normals[face[1]]);
-        draw_normals.push_back(vertex_normals[face[2]]);
-    }
+    bind_vertex_attributes();
 }
-void Mesh::initialize_draw_texture_coordinates()
-{
-    if (!has_texture_coordinates)
-        return;
 
-    draw_texture_coordinates = {};
-    for (auto const &face : faces)
-    {
-        draw_texture_coordinates.push_back(texture_coordinates[face[0]]);
-        draw_texture_coordinates.push_back(texture_coordinates[face[1]]);
-        draw_texture_coordinates.push_back(texture_coordinates[face[2]]);
-    }
+void Mesh::bind_vertex_attributes()
+{
+    gl_state().bind_buffer(GL_ARRAY_BUFFER, vertex_buffer);
+    // Missing w of the position defaults to 1
+    glEnableVertexAttribArray(MESH_VERTEX);
+    glVertexAttribPointer(MESH_VERTEX, 3, GL_FLOAT, false, sizeof(PackedVertex), (void *)offsetof(PackedVertex, position));
+    glEnableVertexAttribArray(MESH_NORMAL);
+    glVertexAttribPointer(MESH_NORMAL, 2, GL_SHORT, true, sizeof(PackedVertex), (void *)offsetof(PackedVertex, normal));
+    glEnableVertexAttribArray(MESH_TEXTURE_COORDINATES);
+    glVertexAttribPointer(MESH_TEXTURE_COORDINATES, 2, GL_HALF_FLOAT, false, sizeof(PackedVertex), (void *)offsetof(PackedVertex, texture_coordinates));
+
+    // Element buffer binding is part of the vertex array state
+    gl_state().bind_buffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
 }
 
 Mesh::~Mesh()
 {
-    if (has_texture_coordinates)
-        glDeleteTextures(1, &diffuse_texture);
+    gl_state().delete_vertex_arrays(1, &vertex_array);
+    gl_state().delete_buffers(1, &vertex_buffer);
+    gl_state().delete_buffers(1, &index_buffer);
+    texture_cache().release(diffuse_texture);
+    texture_cache().release(roughness_texture);
 }
\ No newline at end of file
@@ -1,9 +1,22 @@
 #pragma once
 #include <vector>
+#include <cstdint>
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 #include <assimp/scene.h>
 #include "shaderprogram.h"
+#include "frame_uniforms.hpp"
+#include "mesh_optimizer.hpp"
+#include "asset_pack.hpp"
+#include "bounds.hpp"
+
+// Attribute slots every shader drawing a Mesh declares with layout (location=...)
+enum MeshAttribute
+{
+    MESH_VERTEX = 0,
+    MESH_NORMAL = 1,
+    MESH_TEXTURE_COORDINATES = 2,
+};
 
 class Mesh
 {
@@ -14,25 +27,41 @@ public:
     std::vector<glm::ivec3> faces = {};
     std::string name;
 
-    GLuint diffuse_texture;
-    GLuint roughness_texture;
+    // One texture_cache() reference each, released with the mesh
+    GLuint diffuse_texture = 0;
+    GLuint roughness_texture = 0;
+    // Material textures as referenced by the model, loaded by whoever creates the mesh
+    std::string diffuse_path, roughness_path;
 
+    // GPU copies of the geometry, filled once by initialize_buffers
+    GLuint vertex_array = 0;
+    GLuint vertex_buffer = 0, index_buffer = 0;
+    GLsizei index_count = 0;
+    // Model space, computed from the uploaded vertices
+    Bounds bounds;
+
+    // Reads geometry and texture paths, optimize() and initialize_buffers() have to follow
     Mesh(aiMesh *, const aiScene *);
     Mesh() = default;
-    void draw(ShaderProgram *sp, glm::mat4 P, glm::mat4 V, glm::mat4 M);
-    void drawTextured(ShaderProgram *sp, glm::mat4 P, glm::mat4 V, glm::mat4 M);
-    void drawTexturedShaded(ShaderProgram *sp, glm::mat4 P, glm::mat4 V, glm::mat4 M, glm::vec4 light_position);
-    void initialize_draw_vertices();
-    void initialize_draw_texture_coordinates();
+    // Camera and lights come from the Frame uniform block, only model transforms are uploaded per draw
+    void draw(ShaderProgram *sp, const FrameUniforms &frame, glm::mat4 M);
+    // Only uploads the model transforms and draws, program, textures and vertex_array have to be bound already
+    void draw_bound(ShaderProgram *sp, const FrameUniforms &frame, const glm::mat4 &M);
+    // Merges duplicate vertices and reorders faces and vertices for the post-transform cache and vertex fetch
+    void optimize();
+    // Packs vertices, uploads them and the faces into buffer objects and records them in vertex_array
+    void initialize_buffers();
+    // Same for geometry that is already packed, e.g. mapped from an asset pack
+    void upload_buffers(const PackedVertex *vertices, size_t vertex_count, const uint32_t *indices, size_t index_count);
+    // Points the MeshAttribute slots and the element buffer of the bound vertex array at this mesh's buffers
+    void bind_vertex_attributes();
 
     ~Mesh();
 
-    std::vector<glm::vec4> draw_normals = {};
     bool has_texture_coordinates = false;
-
-private:
-    std::vector<glm::vec4> draw_vertices = {};
-    std::vector<glm::vec2> draw_texture_coordinates = {};
 };
 
-GLuint readTexture(const char *filename);
\ No newline at end of file
+// Loads filename through texture_cache(), the reference has to be released there
+GLuint readTexture(const char *filename);
+// Same for a baked mip chain, uploaded straight from the pack's mapping if it isn't cached yet
+GLuint upload_packed_texture(const AssetPack &pack, const PackTexture &texture);
\ No newline at end of file
@@ -0,0 +1,250 @@
+#include "mesh_optimizer.hpp"
+#include <cstring>
+#include <cmath>
+#include <glm/gtc/packing.hpp>
+
+float average_cache_miss_ratio(const std::vector<glm::ivec3> &faces, unsigned int vertex_count, unsigned int cache_size)
+{
+    if (faces.empty())
+        return 0;
+
+    // Time at which each vertex entered the FIFO, a vertex is cached while it is among the last cache_size entries
+    std::vector<unsigned int> entered(vertex_count, 0);
+    unsigned int time = cache_size + 1, misses = 0;
+
+    for (const auto &face : faces)
+        for (int i = 0; i < 3; ++i)
+            if (time - entered[face[i]] > cache_size)
+            {
+                entered[face[i]] = time++;
+                ++misses;
+            }
+
+    return (float)misses / faces.size();
+}
+
+namespace
+{
+    struct VertexStreams
+    {
+        const std::vector<glm::vec4> &positions;
+        const std::vector<glm::vec4> &normals;
+        const std::vector<glm::vec2> &texture_coordinates;
+
+        bool equal(unsigned int a, unsigned int b) const
+        {
+            return memcmp(&positions[a], &positions[b], sizeof(glm::vec4)) == 0 &&
+                   (normals.empty() || memcmp(&normals[a], &normals[b], sizeof(glm::vec4)) == 0) &&
+                   (texture_coordinates.empty() || memcmp(&texture_coordinates[a], &texture_coordinates[b], sizeof(glm::vec2)) == 0);
+        }
+
+        // FNV-1a over the raw bytes of the vertex
+        unsigned int hash(unsigned int vertex) const
+        {
+            unsigned int h = 2166136261u;
+            auto mix = [&h](const void *data, size_t size)
+            {
+                const unsigned char *bytes = (const unsigned char *)data;
+                for (size_t i = 0; i < size; ++i)
+                    h = (h ^ bytes[i]) * 16777619u;
+            };
+            mix(&positions[vertex], sizeof(glm::vec4));
+            if (!normals.empty())
+                mix(&normals[vertex], sizeof(glm::vec4));
+            if (!texture_coordinates.empty())
+                mix(&texture_coordinates[vertex], sizeof(glm::vec2));
+            return h;
+        }
+    };
+}
+
+unsigned int generate_vertex_remap(std::vector<unsigned int> &remap,
+                                   const std::vector<glm::vec4> &positions,
+                                   const std::vector<glm::vec4> &normals,
+                                   const std::vector<glm::vec2> &texture_coordinates)
+{
+    const unsigned int vertex_count = positions.size();
+    const VertexStreams streams{positions, normals, texture_coordinates};
+
+    // Open addressing table of first occurrences, at most half full
+    unsigned int table_size = 1;
+    while (table_size < vertex_count * 2)
+        table_size *= 2;
+    std::vector<unsigned int> table(table_size, ~0u);
+
+    remap.assign(vertex_count, ~0u);
+    unsigned int unique = 0;
+    for (unsigned int i = 0; i < vertex_count; ++i)
+    {
+        unsigned int slot = streams.hash(i) & (table_size - 1);
+        while (table[slot] != ~0u && !streams.equal(table[slot], i))
+            slot = (slot + 1) & (table_size - 1);
+
+        if (table[slot] == ~0u)
+        {
+            table[slot] = i;
+            remap[i] = unique++;
+        }
+        else
+            remap[i] = remap[table[slot]];
+    }
+
+    return unique;
+}
+
+std::vector<glm::ivec3> optimize_vertex_cache(const std::vector<glm::ivec3> &faces, unsigned int vertex_count, unsigned int cache_size)
+{
+    // Vertex -> adjacent triangles, stored as offsets into one array
+    std::vector<unsigned int> live(vertex_count, 0), offsets(vertex_count + 1, 0), adjacency(faces.size() * 3);
+    for (const auto &face : faces)
+        for (int i = 0; i < 3; ++i)
+            ++live[face[i]];
+    for (unsigned int v = 0; v < vertex_count; ++v)
+        offsets[v + 1] = offsets[v] + live[v];
+    std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+    for (unsigned int t = 0; t < faces.size(); ++t)
+        for (int i = 0; i < 3; ++i)
+            adjacency[fill[faces[t][i]]++] = t;
+
+    std::vector<unsigned int> cache_time(vertex_count, 0), dead_end, candidates;
+    std::vector<bool> emitted(faces.size(), false);
+    std::vector<glm::ivec3> result;
+    result.reserve(faces.size());
+
+    unsigned int time = cache_size + 1, cursor = 0;
+    int fanning = vertex_count > 0 ? 0 : -1;
+
+    while (fanning >= 0)
+    {
+        // Emit every remaining triangle around the fanning vertex
+        candidates.clear();
+        for (unsigned int a = offsets[fanning]; a < offsets[fanning + 1]; ++a)
+        {
+            unsigned int t = adjacency[a];
+            if (emitted[t])
+                continue;
+
+            result.push_back(faces[t]);
+            for (int i = 0; i < 3; ++i)
+            {
+                unsigned int v = faces[t][i];
+                dead_end.push_back(v);
+                candidates.push_back(v);
+                --live[v];
+                if (time - cache_time[v] > cache_size)
+                    cache_time[v] = time++;
+            }
+            emitted[t] = true;
+        }
+
+        // Next fanning vertex: the candidate that stays in cache the longest after emitting its triangles
+        int best = -1, best_priority = -1;
+        for (unsigned int v : candidates)
+        {
+            if (live[v] == 0)
+                continue;
+
+            int priority = 0;
+            if (time - cache_time[v] + 2 * live[v] <= cache_size)
+                priority = time - cache_time[v];
+            if (priority > best_priority)
+            {
+                best_priority = priority;
+                best = v;
+            }
+        }
+
+        if (best < 0)
+        {
+            // Dead end - fall back to recently used vertices, then to the input order
+            while (!dead_end.empty() && best < 0)
+            {
+                unsigned int v = dead_end.back();
+                dead_end.pop_back();
+                if (live[v] > 0)
+                    best = v;
+            }
+            while (best < 0 && cursor < vertex_count)
+            {
+                if (live[cursor] > 0)
+                    best = cursor;
+                ++cursor;
+            }
+        }
+
+        fanning = best;
+    }
+
+    return result;
+}
+
+unsigned int generate_vertex_fetch_remap(std::vector<unsigned int> &remap, const std::vector<glm::ivec3> &faces, unsigned int vertex_count)
+{
+    remap.assign(vertex_count, ~0u);
+    unsigned int next = 0;
+    for (const auto &face : faces)
+        for (int i = 0; i < 3; ++i)
+            if (remap[face[i]] == ~0u)
+                remap[face[i]] = next++;
+    return next;
+}
+
+void remap_faces(std::vector<glm::ivec3> &faces, const std::vector<unsigned int> &remap)
+{
+    for (auto &face : faces)
+        for (int i = 0; i < 3; ++i)
+            face[i] = remap[face[i]];
+}
+
+void optimize_mesh(std::vector<glm::vec4> &positions, std::vector<glm::vec4> &normals, std::vector<glm::vec2> &texture_coordinates, std::vector<glm::ivec3> &faces)
+{
+    std::vector<unsigned int> remap;
+
+    // Merge vertices the importer split per face corner
+    unsigned int unique = generate_vertex_remap(remap, positions, normals, texture_coordinates);
+    remap_faces(faces, remap);
+    remap_vertex_stream(positions, remap, unique);
+    remap_vertex_stream(normals, remap, unique);
+    remap_vertex_stream(texture_coordinates, remap, unique);
+
+    faces = optimize_vertex_cache(faces, unique);
+
+    unique = generate_vertex_fetch_remap(remap, faces, unique);
+    remap_faces(faces, remap);
+    remap_vertex_stream(positions, remap, unique);
+    remap_vertex_stream(normals, remap, unique);
+    remap_vertex_stream(texture_coordinates, remap, unique);
+}
+
+// Maps a unit vector onto the octahedron and unfolds it into [-1,1]^2, decoded by decodeNormal in the vertex shaders
+static glm::vec2 octahedral_encode(glm::vec3 n)
+{
+    n /= fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+    glm::vec2 encoded = glm::vec2(n.x, n.y);
+    if (n.z < 0)
+        encoded = glm::vec2((1 - fabsf(n.y)) * (n.x >= 0 ? 1 : -1), (1 - fabsf(n.x)) * (n.y >= 0 ? 1 : -1));
+    return encoded;
+}
+
+static int16_t pack_snorm16(float value)
+{
+    return (int16_t)roundf(glm::clamp(value, -1.f, 1.f) * 32767.f);
+}
+
+std::vector<PackedVertex> pack_vertices(const std::vector<glm::vec4> &positions, const std::vector<glm::vec4> &normals, const std::vector<glm::vec2> &texture_coordinates)
+{
+    std::vector<PackedVertex> packed(positions.size());
+    for (size_t i = 0; i < positions.size(); ++i)
+    {
+        packed[i].position = glm::vec3(positions[i]);
+
+        glm::vec2 normal = normals.empty() ? glm::vec2(0) : octahedral_encode(glm::vec3(normals[i]));
+        packed[i].normal[0] = pack_snorm16(normal.x);
+        packed[i].normal[1] = pack_snorm16(normal.y);
+
+        glm::vec2 uv = texture_coordinates.empty() ? glm::vec2(0) : texture_coordinates[i];
+        packed[i].texture_coordinates[0] = glm::packHalf1x16(uv.x);
+        packed[i].texture_coordinates[1] = glm::packHalf1x16(uv.y);
+    }
+    return packed;
+}
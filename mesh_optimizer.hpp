@@ -0,0 +1,56 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+// Interleaved GPU vertex, 20 bytes
+struct PackedVertex
+{
+    glm::vec3 position;
+    int16_t normal[2];                // Octahedral encoding, snorm
+    uint16_t texture_coordinates[2]; // Half floats
+};
+
+// Post-transform vertex cache size assumed when ordering triangles
+#define vertex_cache_size 16
+
+/// Average cache miss ratio - vertices transformed per triangle with a FIFO post-transform cache.
+/// 3 for triangle soups, 0.5 is the limit for regular grids.
+float average_cache_miss_ratio(const std::vector<glm::ivec3> &faces, unsigned int vertex_count, unsigned int cache_size = vertex_cache_size);
+
+/// Fills remap with an index into the unique vertices for every vertex and returns the unique vertex count.
+/// Vertices are equal when all of the given streams (empty ones are skipped) are bitwise equal.
+unsigned int generate_vertex_remap(std::vector<unsigned int> &remap,
+                                   const std::vector<glm::vec4> &positions,
+                                   const std::vector<glm::vec4> &normals,
+                                   const std::vector<glm::vec2> &texture_coordinates);
+
+/// Reorders triangles for post-transform cache locality (Tipsify, Sander et al. 2007)
+std::vector<glm::ivec3> optimize_vertex_cache(const std::vector<glm::ivec3> &faces, unsigned int vertex_count, unsigned int cache_size = vertex_cache_size);
+
+/// Fills remap so that vertices are numbered in the order faces first reference them, which keeps vertex fetches sequential.
+/// Unreferenced vertices are mapped to ~0u. Returns the referenced vertex count.
+unsigned int generate_vertex_fetch_remap(std::vector<unsigned int> &remap, const std::vector<glm::ivec3> &faces, unsigned int vertex_count);
+
+void remap_faces(std::vector<glm::ivec3> &faces, const std::vector<unsigned int> &remap);
+
+/// Merges duplicate vertices, then reorders faces for the post-transform cache and vertices for fetch locality.
+/// Empty normal or texture coordinate streams are left empty.
+void optimize_mesh(std::vector<glm::vec4> &positions, std::vector<glm::vec4> &normals, std::vector<glm::vec2> &texture_coordinates, std::vector<glm::ivec3> &faces);
+
+/// Interleaves the streams into the GPU layout, missing normals and texture coordinates become 0
+std::vector<PackedVertex> pack_vertices(const std::vector<glm::vec4> &positions, const std::vector<glm::vec4> &normals, const std::vector<glm::vec2> &texture_coordinates);
+
+/// Moves every vertex to remap[vertex], dropping the ones mapped to ~0u
+template <typename T>
+void remap_vertex_stream(std::vector<T> &stream, const std::vector<unsigned int> &remap, unsigned int new_count)
+{
+    if (stream.empty())
+        return;
+
+    std::vector<T> remapped(new_count);
+    for (unsigned int i = 0; i < remap.size() && i < stream.size(); ++i)
+        if (remap[i] != ~0u)
+            remapped[remap[i]] = stream[i];
+    stream.swap(remapped);
+}
@@ -0,0 +1,76 @@
+#include "mip_chain.hpp"
+#include <algorithm>
+
+size_t mip_chain_size(unsigned width, unsigned height, unsigned levels)
+{
+    size_t size = 0;
+    for (unsigned level = 0; level < levels; ++level)
+        size += (size_t)std::max(1u, width >> level) * std::max(1u, height >> level) * 4;
+    return size;
+}
+
+size_t MipChain::level_offset(unsigned level) const
+{
+    return mip_chain_size(width, height, level);
+}
+
+unsigned full_mip_levels(unsigned width, unsigned height)
+{
+    unsigned levels = 1;
+    while (width >> levels || height >> levels)
+        ++levels;
+    return levels;
+}
+
+// Source texels of one destination texel along an axis and their weights. Even sizes average pairs, odd ones
+// use 3 overlapping taps so every texel of the previous level, the last one included, weighs the same in total.
+struct FilterTaps
+{
+    unsigned index[3];
+    float weight[3];
+    unsigned count;
+};
+
+static FilterTaps filter_taps(unsigned size, unsigned next_size, unsigned i)
+{
+    if (size == 1)
+        return FilterTaps{{0}, {1.f}, 1};
+    if (size % 2 == 0)
+        return FilterTaps{{2 * i, 2 * i + 1}, {0.5f, 0.5f}, 2};
+    const float scale = 1.f / size;
+    return FilterTaps{{2 * i, 2 * i + 1, 2 * i + 2}, {(next_size - i) * scale, next_size * scale, (i + 1) * scale}, 3};
+}
+
+void build_mip_chain(MipChain &chain)
+{
+    chain.levels = full_mip_levels(chain.width, chain.height);
+    chain.pixels.resize(mip_chain_size(chain.width, chain.height, chain.levels));
+
+    for (unsigned level = 1; level < chain.levels; ++level)
+    {
+        unsigned width = chain.level_width(level - 1), height = chain.level_height(level - 1);
+        unsigned next_width = chain.level_width(level), next_height = chain.level_height(level);
+        const unsigned char *source = &chain.pixels[chain.level_offset(level - 1)];
+        unsigned char *destination = &chain.pixels[chain.level_offset(level)];
+
+        for (unsigned y = 0; y < next_height; ++y)
+        {
+            const FilterTaps rows = filter_taps(height, next_height, y);
+            for (unsigned x = 0; x < next_width; ++x)
+            {
+                const FilterTaps columns = filter_taps(width, next_width, x);
+                float sum[4] = {};
+                for (unsigned j = 0; j < rows.count; ++j)
+                    for (unsigned i = 0; i < columns.count; ++i)
+                    {
+                        const unsigned char *texel = &source[((size_t)rows.index[j] * width + columns.index[i]) * 4];
+                        const float weight = rows.weight[j] * columns.weight[i];
+                        for (int c = 0; c < 4; ++c)
+                            sum[c] += weight * texel[c];
+                    }
+                for (int c = 0; c < 4; ++c)
+                    destination[((size_t)y * next_width + x) * 4 + c] = (unsigned char)std::min(255.f, sum[c] + 0.5f);
+            }
+        }
+    }
+}
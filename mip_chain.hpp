@@ -0,0 +1,24 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+/// RGBA8 image with its mip chain. Level i is max(1, width >> i) x max(1, height >> i) texels and follows level i - 1.
+struct MipChain
+{
+    unsigned width = 0, height = 0, levels = 0;
+    std::vector<unsigned char> pixels;
+
+    unsigned level_width(unsigned level) const { return width >> level ? width >> level : 1; }
+    unsigned level_height(unsigned level) const { return height >> level ? height >> level : 1; }
+    size_t level_offset(unsigned level) const;
+};
+
+/// Bytes of the first levels of a width x height RGBA8 chain
+size_t mip_chain_size(unsigned width, unsigned height, unsigned levels);
+
+/// Level count of a full chain down to 1x1
+unsigned full_mip_levels(unsigned width, unsigned height);
+
+/// Appends every level down to 1x1 to the decoded level 0 in pixels.
+/// Each level is a 2x2 box filter of the previous one, odd dimensions use a 3 tap filter instead so no texel is dropped.
+void build_mip_chain(MipChain &chain);
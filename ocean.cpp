@@ -0,0 +1,111 @@
+#include "ocean.hpp"
+#include "texture_cache.hpp"
+#include "gl_state.hpp"
+#include <cassert>
+#include <glm/gtc/matrix_transform.hpp>
+
+/// Grid of unit cells with corners in [x0, x1] x [z0, z1] on the XZ plane,
+/// cells inside [hole_x0, hole_x1] x [hole_z0, hole_z1] are left out
+static Mesh *generate_grid(int x0, int z0, int x1, int z1, int hole_x0 = 0, int hole_z0 = 0, int hole_x1 = 0, int hole_z1 = 0)
+{
+    Mesh *m = new Mesh();
+    int n_x = x1 - x0 + 1, n_z = z1 - z0 + 1;
+
+    m->vertex_positons.reserve(n_x * n_z);
+    for (int x = x0; x <= x1; ++x)
+        for (int z = z0; z <= z1; ++z)
+            m->vertex_positons.push_back(glm::vec4(x, 0, z, 1));
+    m->vertex_normals = std::vector<glm::vec4>(n_x * n_z, glm::vec4(0, 1, 0, 0));
+    m->has_texture_coordinates = true;
+    m->texture_coordinates = std::vector<glm::vec2>(n_x * n_z, glm::vec2(0.5f));
+    // The texture is shared between all tiles and owned by Ocean
+    m->diffuse_texture = 0;
+
+    for (int x = x0; x < x1; ++x)
+        for (int z = z0; z < z1; ++z)
+        {
+            if (x >= hole_x0 && x < hole_x1 && z >= hole_z0 && z < hole_z1)
+                continue;
+
+            int index = (x - x0) * n_z + (z - z0);
+            m->faces.push_back(glm::ivec3(index, index + 1, index + n_z));
+            m->faces.push_back(glm::ivec3(index + 1, index + n_z + 1, index + n_z));
+        }
+
+    m->name = "ocean";
+    // Drops the vertices inside the hole as well
+    m->optimize();
+    m->initialize_buffers();
+    return m;
+}
+
+Ocean::Ocean(int extent, float spacing, int levels, GLuint texture)
+{
+    assert(extent >= 4 && extent % 2 == 0);
+    assert(levels > 0);
+    this->extent = extent;
+    this->spacing = spacing;
+    this->levels = levels;
+    this->texture = texture;
+
+    int half = extent / 2;
+    block = generate_grid(-extent, -extent, extent, extent);
+    ring = generate_grid(-extent, -extent, extent, extent, -half, -half, half + 1, half + 1);
+    vertical_trim = generate_grid(0, 0, 1, extent + 1);
+    horizontal_trim = generate_grid(0, 0, extent, 1);
+}
+
+Ocean::~Ocean()
+{
+    delete block;
+    delete ring;
+    delete vertical_trim;
+    delete horizontal_trim;
+    texture_cache().release(texture);
+}
+
+void Ocean::draw_tile(Mesh *tile, ShaderProgram *sp, const FrameUniforms &frame, const glm::mat4 &M, glm::vec2 tile_offset)
+{
+    glUniform2f(sp->getUniformLocation(UNIFORM_TILE_OFFSET), tile_offset.x, tile_offset.y);
+    tile->draw(sp, frame, M);
+}
+
+unsigned Ocean::draw(ShaderProgram *sp, const FrameUniforms &frame, glm::mat4 M)
+{
+    glm::vec4 camera = glm::inverse(M) * frame.camera_position;
+    int half = extent / 2;
+
+    sp->use();
+    gl_state().bind_texture(0, texture);
+    sp->setSampler(UNIFORM_TEX, 0);
+    glUniform1f(sp->getUniformLocation(UNIFORM_LEVEL_EXTENT), extent);
+
+    glm::vec2 finer_origin;
+    for (int level = 0; level < levels; ++level)
+    {
+        float level_spacing = spacing * (1 << level);
+        // Snapping to twice the spacing keeps even vertices of a level on the grid of the next one
+        glm::vec2 origin = glm::floor(glm::vec2(camera.x, camera.z) / (2 * level_spacing)) * (2 * level_spacing);
+
+        glUniform1f(sp->getUniformLocation(UNIFORM_LEVEL_SCALE), level_spacing);
+        glUniform2f(sp->getUniformLocation(UNIFORM_LEVEL_OFFSET), origin.x, origin.y);
+
+        if (level == 0)
+        {
+            draw_tile(block, sp, frame, M, glm::vec2(0));
+        }
+        else
+        {
+            draw_tile(ring, sp, frame, M, glm::vec2(0));
+
+            // The finer level covers [-half, half] shifted by 0 or 1 cell, the trims fill the rest of the hole
+            glm::vec2 shift = glm::round((finer_origin - origin) / level_spacing);
+            draw_tile(vertical_trim, sp, frame, M, glm::vec2(shift.x == 0 ? half : -half, -half));
+            draw_tile(horizontal_trim, sp, frame, M, glm::vec2(-half + shift.x, shift.y == 0 ? half : -half));
+        }
+
+        finer_origin = origin;
+    }
+    // Block, then a ring and two trims per level
+    return 1 + 3 * (levels - 1);
+}
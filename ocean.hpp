@@ -0,0 +1,37 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+#include "shaderprogram.h"
+#include "frame_uniforms.hpp"
+
+/// Geometry clipmap of the water surface.
+/// Level 0 is a (2 * extent)^2 cell block around the camera, every further level is a ring of the same
+/// cell count with doubled spacing. Each level snaps to twice its own spacing, the one cell gap that leaves
+/// between a level and the ring around it is closed by an L-shaped pair of trim strips.
+/// T-junctions on the outer edge of a level are stitched in v_water.glsl.
+class Ocean
+{
+public:
+    /// extent - half size of a level in its own cells, must be even
+    /// spacing - cell size of level 0 in model space units
+    /// texture - a texture_cache() reference, released with the ocean
+    Ocean(int extent, float spacing, int levels, GLuint texture);
+    ~Ocean();
+
+    /// Draws all levels around the camera, wave uniforms have to be set on sp beforehand. Returns the draw calls issued.
+    unsigned draw(ShaderProgram *sp, const FrameUniforms &frame, glm::mat4 M);
+
+private:
+    int extent, levels;
+    float spacing;
+    GLuint texture;
+
+    Mesh *block;            // Level 0
+    Mesh *ring;             // Levels 1+, hole of extent + 1 cells for the finer level
+    Mesh *vertical_trim;    // 1 x (extent + 1) cells
+    Mesh *horizontal_trim;  // extent x 1 cells
+
+    void draw_tile(Mesh *tile, ShaderProgram *sp, const FrameUniforms &frame, const glm::mat4 &M, glm::vec2 tile_offset);
+};
@@ -0,0 +1,107 @@
+#include "particle_manager.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include "job_system.hpp"
+
+ParticleManager::ParticleManager(size_t live_budget, size_t spawn_budget)
+{
+    this->live_budget = live_budget;
+    this->spawn_budget = spawn_budget;
+}
+
+ParticleManager::~ParticleManager()
+{
+    for (ParticleSystem *emitter : emitters)
+        delete emitter;
+}
+
+void ParticleManager::add(ParticleSystem *emitter)
+{
+    emitters.push_back(emitter);
+    budgets.push_back(EmitterBudget{1, 0, 0, 0, 0});
+}
+
+// Height of the plume's bounding sphere on screen relative to the viewport, mapped to [particle_lod_min, 1]
+float ParticleManager::screen_size_lod(ParticleSystem *emitter, const FrameUniforms &frame, const glm::mat4 &root_object) const
+{
+    glm::vec4 view_position = frame.V * root_object * emitter->get_origin();
+    float depth = -view_position.z;
+    float radius = emitter->get_reach();
+    // Camera inside the plume
+    if (depth <= radius)
+        return 1;
+
+    // P[1][1] is the cotangent of half the vertical field of view
+    float projected = radius * frame.P[1][1] / depth;
+    return std::max(particle_lod_min, std::min(1.f, projected / particle_lod_full_size));
+}
+
+void ParticleManager::update(float deltaTime, const FrameUniforms &frame, glm::mat4 root_object)
+{
+    size_t live = 0;
+    float total_rate = 0;
+    for (size_t i = 0; i < emitters.size(); ++i)
+    {
+        float lod = screen_size_lod(emitters[i], frame, root_object);
+        // Fewer, bigger particles keep the plume's coverage
+        emitters[i]->set_lod(lod, 1 / sqrtf(lod));
+        budgets[i].lod = lod;
+        live += emitters[i]->get_live_count();
+        total_rate += emitters[i]->get_emission_rate();
+    }
+
+    // What may be emitted this update, shared in proportion to the emission rates
+    size_t available = live < live_budget ? std::min(spawn_budget, live_budget - live) : 0;
+    for (size_t i = 0; i < emitters.size(); ++i)
+        budgets[i].allowed = total_rate > 0 ? (size_t)(available * emitters[i]->get_emission_rate() / total_rate) : 0;
+
+    // CPU emitters are independent jobs, GPU ones issue GL calls and stay on this thread
+    auto update_emitter = [&](size_t i)
+    {
+        EmitterBudget &budget = budgets[i];
+        emitters[i]->update(deltaTime, root_object, budget.allowed);
+        budget.requested = emitters[i]->get_requested();
+        budget.spawned = emitters[i]->get_spawned();
+        budget.live = emitters[i]->get_live_count();
+    };
+    job_system().parallel_for(emitters.size(), 1, [&](size_t begin, size_t end)
+                              {
+        for (size_t i = begin; i < end; ++i)
+            if (emitters[i]->get_backend() == PARTICLES_CPU)
+                update_emitter(i); });
+    for (size_t i = 0; i < emitters.size(); ++i)
+        if (emitters[i]->get_backend() == PARTICLES_GPU)
+            update_emitter(i);
+}
+
+void ParticleManager::write_snapshots(std::vector<ParticleSnapshot> &snapshots) const
+{
+    snapshots.resize(emitters.size());
+    for (size_t i = 0; i < emitters.size(); ++i)
+        emitters[i]->write_snapshot(snapshots[i]);
+}
+
+CullStats ParticleManager::draw(const FrameUniforms &frame, const std::vector<ParticleSnapshot> &snapshots, const Frustum &frustum)
+{
+    CullStats stats;
+    for (size_t i = 0; i < emitters.size(); ++i)
+    {
+        ++stats.tested;
+        if (!frustum.intersects(snapshots[i].bounds))
+            continue;
+        emitters[i]->draw(frame, snapshots[i]);
+        ++stats.visible;
+    }
+    return stats;
+}
+
+void ParticleManager::print_budgets() const
+{
+    for (size_t i = 0; i < budgets.size(); ++i)
+    {
+        const EmitterBudget &budget = budgets[i];
+        printf("emitter %zu: lod %.2f, spawned %zu/%zu (allowed %zu), live %zu/%zu\n",
+               i, budget.lod, budget.spawned, budget.requested, budget.allowed, budget.live, emitters[i]->get_capacity());
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <glm/glm.hpp>
+
+#include "particle_system.hpp"
+#include "frame_uniforms.hpp"
+#include "bounds.hpp"
+
+// Live particles over all emitters
+#define particle_live_budget 16384
+// Particles emitted per update over all emitters
+#define particle_spawn_budget 1024
+// Projected plume height, as a fraction of the viewport height, from which an emitter runs at full detail
+#define particle_lod_full_size 0.5f
+// Emission scale of emitters that are tiny or behind the camera
+#define particle_lod_min 0.05f
+
+/// Budget use of one emitter during the last update
+struct EmitterBudget
+{
+    float lod;        // Emission scale from the projected size
+    size_t requested; // Particles the emitter wanted to emit
+    size_t allowed;   // Its share of the spawn budget
+    size_t spawned;
+    size_t live;
+};
+
+/// Owns all particle emitters and keeps their total cost bounded.
+/// Emitters are scaled by their projected size - smaller plumes emit fewer, bigger particles -
+/// and the spawn budget left by the live particle budget is shared in proportion to the scaled rates.
+class ParticleManager
+{
+public:
+    ParticleManager(size_t live_budget = particle_live_budget, size_t spawn_budget = particle_spawn_budget);
+    ~ParticleManager();
+
+    /// Takes ownership of emitter
+    void add(ParticleSystem *emitter);
+
+    void update(float deltaTime, const FrameUniforms &frame, glm::mat4 root_object = glm::mat4(1.f));
+    /// Resizes snapshots to one per emitter
+    void write_snapshots(std::vector<ParticleSnapshot> &snapshots) const;
+    /// Draws the emitters whose snapshot bounds intersect the frustum, returns how many were tested and drawn
+    CullStats draw(const FrameUniforms &frame, const std::vector<ParticleSnapshot> &snapshots, const Frustum &frustum);
+
+    /// Parallel to the emitters in the order they were added
+    const std::vector<EmitterBudget> &get_budgets() const { return budgets; }
+    void print_budgets() const;
+
+private:
+    size_t live_budget, spawn_budget;
+    std::vector<ParticleSystem *> emitters;
+    std::vector<EmitterBudget> budgets;
+
+    float screen_size_lod(ParticleSystem *emitter, const FrameUniforms &frame, const glm::mat4 &root_object) const;
+};
@@ -1,15 +1,60 @@
 #define GLM_FORCE_RADIANS
 
 #include <random>
-#include <glm/gtc/matrix_transform.hpp>
+#include <new>
+#include <cassert>
+#include <cstddef>
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
 #include "particle_system.hpp"
 #include "constants.hpp"
+#include "frame_arena.hpp"
+#include "job_system.hpp"
+#include "gl_state.hpp"
 
-std::vector<glm::vec3> generate_random_positions(int n, glm::vec4 origin, glm::vec3 deviation);
-std::vector<glm::vec3> generate_random_velocities(int n, glm::vec4 up, glm::vec4 right, float base_speed, float speed_deviation, float max_angle);
-std::vector<float> generate_random_lifetimes(int n, float base, float deviation);
+#define particle_pool_alignment 64
 
-ParticleSystem::ParticleSystem(glm::vec4 origin, glm::vec3 position_deviation, float spawn_rate, glm::vec4 direction, float max_angle, float initial_speed, float initial_speed_deviation, float drag, float lifetime, float lifetime_deviation, Mesh *particle_model, ShaderProgram *shader)
+template <typename T>
+static T *allocate_aligned(size_t n)
+{
+    return (T *)::operator new(n * sizeof(T), std::align_val_t(particle_pool_alignment));
+}
+
+static void free_aligned(void *memory)
+{
+    ::operator delete(memory, std::align_val_t(particle_pool_alignment));
+}
+
+ParticlePool::ParticlePool(size_t capacity)
+{
+    this->capacity = capacity;
+    count = 0;
+    positions = allocate_aligned<glm::vec3>(capacity);
+    previous_positions = allocate_aligned<glm::vec3>(capacity);
+    velocities = allocate_aligned<glm::vec3>(capacity);
+    lifetimes = allocate_aligned<float>(capacity);
+}
+
+ParticlePool::~ParticlePool()
+{
+    free_aligned(positions);
+    free_aligned(previous_positions);
+    free_aligned(velocities);
+    free_aligned(lifetimes);
+}
+
+void ParticlePool::retire(size_t i)
+{
+    --count;
+    positions[i] = positions[count];
+    previous_positions[i] = previous_positions[count];
+    velocities[i] = velocities[count];
+    lifetimes[i] = lifetimes[count];
+}
+
+ParticleSystem::ParticleSystem(glm::vec4 origin, glm::vec3 position_deviation, float spawn_rate, glm::vec4 direction, float max_angle, float initial_speed, float initial_speed_deviation, float drag, float lifetime, float lifetime_deviation, Mesh *particle_model, ShaderProgram *shader, size_t capacity)
+    : particles(capacity), rng(std::random_device{}())
 {
     this->origin = origin;
     this->position_deviation = position_deviation;
@@ -23,118 +68,344 @@ ParticleSystem::ParticleSystem(glm::vec4 origin, glm::vec3 position_deviation, f
     this->lifetime_deviation = lifetime_deviation;
     this->particle = particle_model;
     this->shader = shader;
-    particle_positions = {};
-    particle_velocity = {};
-    particle_lifetime_remaining = {};
+    // Orthonormal basis around the emission direction
+    up = glm::normalize(glm::vec3(direction));
+    right = glm::normalize(glm::cross(up, up + glm::vec3(1, 0, 1)));
+    forward = glm::cross(up, right);
+
+    time_step = particle_time_step;
+    accumulator = 0;
+    spawn_accumulator = 0;
+    tick = 0;
+    uploaded_tick = ~0ul;
+    emission_scale = size_scale = 1;
+    requested = spawned = 0;
+    emitter_low = glm::vec3(FLT_MAX);
+    emitter_high = glm::vec3(-FLT_MAX);
+    emitting_time = 0;
+
+    backend = PARTICLES_CPU;
+    update_shader = nullptr;
+    state_buffers[0] = state_buffers[1] = 0;
+    update_vertex_arrays[0] = update_vertex_arrays[1] = 0;
+    render_vertex_arrays[0] = render_vertex_arrays[1] = 0;
+    current = 0;
+    emit_cursor = 0;
+
+    // Positions of all slots followed by their lifetimes and previous positions
+    glGenBuffers(1, &instance_buffer);
+    gl_state().bind_buffer(GL_ARRAY_BUFFER, instance_buffer);
+    glBufferData(GL_ARRAY_BUFFER, capacity * (2 * sizeof(glm::vec3) + sizeof(float)), nullptr, GL_STREAM_DRAW);
+
+    glGenVertexArrays(1, &vertex_array);
+    gl_state().bind_vertex_array(vertex_array);
+    particle->bind_vertex_attributes();
+    gl_state().bind_buffer(GL_ARRAY_BUFFER, instance_buffer);
+    glEnableVertexAttribArray(PARTICLE_POSITION);
+    glVertexAttribPointer(PARTICLE_POSITION, 3, GL_FLOAT, false, 0, nullptr);
+    glVertexAttribDivisor(PARTICLE_POSITION, 1);
+    glEnableVertexAttribArray(PARTICLE_LIFETIME);
+    glVertexAttribPointer(PARTICLE_LIFETIME, 1, GL_FLOAT, false, 0, (void *)(capacity * sizeof(glm::vec3)));
+    glVertexAttribDivisor(PARTICLE_LIFETIME, 1);
+    glEnableVertexAttribArray(PARTICLE_PREVIOUS_POSITION);
+    glVertexAttribPointer(PARTICLE_PREVIOUS_POSITION, 3, GL_FLOAT, false, 0, (void *)(capacity * (sizeof(glm::vec3) + sizeof(float))));
+    glVertexAttribDivisor(PARTICLE_PREVIOUS_POSITION, 1);
+    gl_state().bind_vertex_array(0);
+    gl_state().bind_buffer(GL_ARRAY_BUFFER, 0);
 }
 
-void ParticleSystem::draw(float deltaTime, glm::mat4 P, glm::mat4 V, glm::mat4 root_object)
+ParticleSystem::~ParticleSystem()
 {
-    static glm::vec4 right = glm::normalize(glm::vec4(glm::cross(glm::vec3(this->direction), glm::vec3(this->direction) + glm::vec3(1, 0, 1)), 1));
-    // Erase particles that exceeded their lifetime
-    for (int i = 0; i < particle_lifetime_remaining.size();)
+    gl_state().delete_vertex_arrays(1, &vertex_array);
+    gl_state().delete_buffers(1, &instance_buffer);
+    if (backend == PARTICLES_GPU)
     {
-        if ((particle_lifetime_remaining.at(i) -= deltaTime) < 0)
-        {
-            particle_positions.erase(particle_positions.begin() + i);
-            particle_velocity.erase(particle_velocity.begin() + i);
-            particle_lifetime_remaining.erase(particle_lifetime_remaining.begin() + i);
-        }
-        else
-            ++i;
+        gl_state().delete_vertex_arrays(2, update_vertex_arrays);
+        gl_state().delete_vertex_arrays(2, render_vertex_arrays);
+        gl_state().delete_buffers(2, state_buffers);
     }
+}
 
-    glEnableVertexAttribArray(this->shader->getAttributeLocation("normal"));
-    glVertexAttribPointer(this->shader->getAttributeLocation("normal"), 4, GL_FLOAT, false, 0, particle->draw_normals.data());
+void ParticleSystem::enable_gpu_simulation(ShaderProgram *update_shader)
+{
+    assert(backend == PARTICLES_CPU);
+    backend = PARTICLES_GPU;
+    this->update_shader = update_shader;
+
+    // Every slot starts dead
+    std::vector<ParticleState> initial(particles.capacity, ParticleState{glm::vec3(0), 0, glm::vec3(0)});
+    glGenBuffers(2, state_buffers);
+    glGenVertexArrays(2, update_vertex_arrays);
+    glGenVertexArrays(2, render_vertex_arrays);
 
-    for (int i = 0; i < particle_positions.size(); ++i)
+    for (int i = 0; i < 2; ++i)
     {
-        // Move according to particle's velocity
-        particle_positions.at(i) += particle_velocity.at(i) * deltaTime;
-        // Decrease velocity
-        particle_velocity.at(i) -= drag * particle_velocity.at(i) * deltaTime;
+        gl_state().bind_buffer(GL_ARRAY_BUFFER, state_buffers[i]);
+        glBufferData(GL_ARRAY_BUFFER, initial.size() * sizeof(ParticleState), initial.data(), GL_DYNAMIC_COPY);
 
-        particle->draw(shader, P, V, glm::translate(glm::mat4(1), particle_positions.at(i)));
+        // Attribute locations of v_particle_update.glsl
+        gl_state().bind_vertex_array(update_vertex_arrays[i]);
+        gl_state().bind_buffer(GL_ARRAY_BUFFER, state_buffers[i]);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, false, sizeof(ParticleState), (void *)offsetof(ParticleState, position));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 1, GL_FLOAT, false, sizeof(ParticleState), (void *)offsetof(ParticleState, lifetime));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 3, GL_FLOAT, false, sizeof(ParticleState), (void *)offsetof(ParticleState, velocity));
+
+        gl_state().bind_vertex_array(render_vertex_arrays[i]);
+        particle->bind_vertex_attributes();
+        gl_state().bind_buffer(GL_ARRAY_BUFFER, state_buffers[i]);
+        glEnableVertexAttribArray(PARTICLE_POSITION);
+        glVertexAttribPointer(PARTICLE_POSITION, 3, GL_FLOAT, false, sizeof(ParticleState), (void *)offsetof(ParticleState, position));
+        glVertexAttribDivisor(PARTICLE_POSITION, 1);
+        glEnableVertexAttribArray(PARTICLE_LIFETIME);
+        glVertexAttribPointer(PARTICLE_LIFETIME, 1, GL_FLOAT, false, sizeof(ParticleState), (void *)offsetof(ParticleState, lifetime));
+        glVertexAttribDivisor(PARTICLE_LIFETIME, 1);
+        gl_state().bind_buffer(GL_ARRAY_BUFFER, state_buffers[1 - i]);
+        glEnableVertexAttribArray(PARTICLE_PREVIOUS_POSITION);
+        glVertexAttribPointer(PARTICLE_PREVIOUS_POSITION, 3, GL_FLOAT, false, sizeof(ParticleState), (void *)offsetof(ParticleState, position));
+        glVertexAttribDivisor(PARTICLE_PREVIOUS_POSITION, 1);
     }
+    gl_state().bind_vertex_array(0);
+    gl_state().bind_buffer(GL_ARRAY_BUFFER, 0);
+}
 
-    glDisableVertexAttribArray(this->shader->getAttributeLocation("normal"));
+void ParticleSystem::seed(uint64_t seed)
+{
+    rng.seed(seed);
+}
 
-    int to_spawn = spawn_rate * deltaTime;
+void ParticleSystem::spawn(size_t first, size_t n, glm::vec4 emitter)
+{
+    // One plane of n uniform variates per random quantity:
+    // 0-3 Box-Muller pairs for the position offset and the speed, 4-5 direction, 6 lifetime.
+    // Kept per emitter rather than in the frame arena, emitters are updated on worker threads.
+    random_values.resize(7 * n);
+    const float *u = random_values.data();
+    rng.fill_uniform(random_values.data(), random_values.size());
+    const float *radius_a = &u[0], *angle_a = &u[n], *radius_b = &u[2 * n], *angle_b = &u[3 * n],
+                *cap_height = &u[4 * n], *azimuth = &u[5 * n], *age = &u[6 * n];
 
-    // Create new particles
-    auto new_positions = generate_random_positions(to_spawn, root_object * this->origin, this->position_deviation);
-    auto new_velocities = generate_random_velocities(to_spawn, this->direction, right, this->initial_speed, this->initial_speed_deviation, this->max_angle);
-    auto new_lifetimes = generate_random_lifetimes(to_spawn, this->lifetime, this->lifetime_deviation);
+    glm::vec3 *positions = particles.positions + first, *velocities = particles.velocities + first;
+    float *lifetimes = particles.lifetimes + first;
+    glm::vec3 center = glm::vec3(emitter);
+    float cos_max_angle = cosf(max_angle);
+
+    job_system().parallel_for(n, particle_job_chunk, [&](size_t begin, size_t end)
+                              {
+        for (size_t i = begin; i < end; ++i)
+        {
+            // Four independent standard normals, 1 - u keeps the logarithm finite
+            float r_a = sqrtf(-2 * logf(1 - radius_a[i])), r_b = sqrtf(-2 * logf(1 - radius_b[i]));
+            float phi_a = TAU * angle_a[i], phi_b = TAU * angle_b[i];
+            positions[i] = center + position_deviation * glm::vec3(r_a * cosf(phi_a), r_a * sinf(phi_a), r_b * cosf(phi_b));
+            float speed = initial_speed + initial_speed_deviation * r_b * sinf(phi_b);
 
-    particle_positions.insert(particle_positions.end(), new_positions.begin(), new_positions.end());
-    particle_velocity.insert(particle_velocity.end(), new_velocities.begin(), new_velocities.end());
-    particle_lifetime_remaining.insert(particle_lifetime_remaining.end(), new_lifetimes.begin(), new_lifetimes.end());
+            // Uniform over the spherical cap within max_angle of up
+            float cos_theta = 1 - cap_height[i] * (1 - cos_max_angle);
+            float sin_theta = sqrtf(std::max(0.f, 1 - cos_theta * cos_theta));
+            float phi = TAU * azimuth[i];
+            velocities[i] = speed * (cos_theta * up + sin_theta * (cosf(phi) * right + sinf(phi) * forward));
+
+            lifetimes[i] = lifetime + lifetime_deviation * (2 * age[i] - 1);
+        }
+        // Nothing to interpolate from yet
+        std::copy(positions + begin, positions + end, particles.previous_positions + first + begin); });
 }
 
-std::vector<glm::vec3> generate_random_positions(int n, glm::vec4 origin, glm::vec3 deviation)
+void ParticleSystem::set_lod(float emission_scale, float size_scale)
 {
-    static std::random_device rng{};
-    static std::mt19937 generator{rng()};
-    static std::normal_distribution<float>
-        position_distribution_x(-deviation.x, deviation.x),
-        position_distribution_y(-deviation.y, deviation.y),
-        position_distribution_z(-deviation.z, deviation.z);
+    this->emission_scale = emission_scale;
+    this->size_scale = size_scale;
+}
 
-    std::vector<glm::vec3> positions;
-    positions.reserve(n);
+size_t ParticleSystem::get_live_count() const
+{
+    if (backend == PARTICLES_GPU)
+        return std::min(particles.capacity, (size_t)(get_emission_rate() * lifetime));
+    return particles.count;
+}
+
+void ParticleSystem::update(float deltaTime, glm::mat4 root_object, size_t spawn_limit)
+{
+    glm::vec4 emitter = root_object * this->origin;
+    requested = spawned = 0;
+    emitter_low = glm::min(emitter_low, glm::vec3(emitter));
+    emitter_high = glm::max(emitter_high, glm::vec3(emitter));
+
+    accumulator = std::min(accumulator + deltaTime, particle_max_steps * time_step);
+    while (accumulator >= time_step)
+    {
+        accumulator -= time_step;
+        ++tick;
+        emitting_time += time_step;
+
+        // Whole particles are emitted, the fraction waits for the next tick
+        spawn_accumulator += get_emission_rate() * time_step;
+        size_t to_spawn = (size_t)spawn_accumulator;
+        spawn_accumulator -= to_spawn;
+        requested += to_spawn;
+        to_spawn = std::min(to_spawn, spawn_limit - spawned);
+
+        if (backend == PARTICLES_GPU)
+            spawned += step_on_gpu(to_spawn, emitter);
+        else
+            spawned += step_on_cpu(to_spawn, emitter);
+    }
+}
+
+void ParticleSystem::write_snapshot(ParticleSnapshot &snapshot) const
+{
+    snapshot.interpolation = accumulator / time_step;
+    snapshot.size_scale = size_scale;
+    // Particles are drawn around their positions up to the mesh's radius, grown over their life
+    float particle_radius = particle->bounds.radius * size_scale * particle_max_size_growth;
+
+    if (backend == PARTICLES_GPU)
+    {
+        // Everything emitted so far is within reach of some emitter position, the reach grows until the first particles die
+        float reach = get_max_reach() * std::min(1.f, emitting_time / (lifetime + lifetime_deviation)) + particle_radius;
+        snapshot.bounds.center = (emitter_low + emitter_high) * 0.5f;
+        snapshot.bounds.extent = (emitter_high - emitter_low) * 0.5f + glm::vec3(reach);
+        snapshot.bounds.radius = glm::length(snapshot.bounds.extent);
+        return;
+    }
+    if (snapshot.tick == tick)
+        return;
+
+    snapshot.tick = tick;
+    snapshot.count = particles.count;
+    snapshot.positions.assign(particles.positions, particles.positions + particles.count);
+    snapshot.previous_positions.assign(particles.previous_positions, particles.previous_positions + particles.count);
+    snapshot.lifetimes.assign(particles.lifetimes, particles.lifetimes + particles.count);
+
+    // Drawn positions are interpolated between the two ticks, so both are inside
+    Bounds current = compute_bounds(particles.positions, particles.count), previous = compute_bounds(particles.previous_positions, particles.count);
+    glm::vec3 low = glm::min(current.center - current.extent, previous.center - previous.extent) - glm::vec3(particle_radius);
+    glm::vec3 high = glm::max(current.center + current.extent, previous.center + previous.extent) + glm::vec3(particle_radius);
+    snapshot.bounds.center = (low + high) * 0.5f;
+    snapshot.bounds.extent = (high - low) * 0.5f;
+    snapshot.bounds.radius = glm::length(snapshot.bounds.extent);
+}
 
-    for (int i = 0; i < n; ++i)
+float ParticleSystem::get_max_reach() const
+{
+    float max_speed = initial_speed + particle_bound_deviations * initial_speed_deviation;
+    float max_offset = particle_bound_deviations * std::max(position_deviation.x, std::max(position_deviation.y, position_deviation.z));
+    // Drag only slows particles down
+    return max_speed * (lifetime + lifetime_deviation) + max_offset;
+}
+
+void ParticleSystem::draw(const FrameUniforms &frame, const ParticleSnapshot &snapshot)
+{
+    if (backend == PARTICLES_GPU)
     {
-        positions.push_back(origin + glm::vec4(
-                                         position_distribution_x(generator),
-                                         position_distribution_y(generator),
-                                         position_distribution_z(generator),
-                                         0));
+        // Every slot is drawn, the particle shader drops the dead ones
+        draw_instances(frame, snapshot, render_vertex_arrays[current], particles.capacity);
+        return;
     }
 
-    return positions;
-};
+    if (uploaded_tick != snapshot.tick)
+    {
+        size_t capacity = particles.capacity, count = snapshot.count;
+        gl_state().bind_buffer(GL_ARRAY_BUFFER, instance_buffer);
+        glBufferData(GL_ARRAY_BUFFER, capacity * (2 * sizeof(glm::vec3) + sizeof(float)), nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(glm::vec3), snapshot.positions.data());
+        glBufferSubData(GL_ARRAY_BUFFER, capacity * sizeof(glm::vec3), count * sizeof(float), snapshot.lifetimes.data());
+        glBufferSubData(GL_ARRAY_BUFFER, capacity * (sizeof(glm::vec3) + sizeof(float)), count * sizeof(glm::vec3), snapshot.previous_positions.data());
+        uploaded_tick = snapshot.tick;
+    }
+    draw_instances(frame, snapshot, vertex_array, snapshot.count);
+}
 
-std::vector<glm::vec3> generate_random_velocities(int n, glm::vec4 up, glm::vec4 right, float base_speed, float speed_deviation, float max_angle)
+// One instanced draw of the particle model, instance positions are already in world space
+void ParticleSystem::draw_instances(const FrameUniforms &frame, const ParticleSnapshot &snapshot, GLuint vertex_array, size_t instances)
 {
-    static std::random_device rng{};
-    static std::mt19937 generator{rng()};
-    static std::normal_distribution<float> speed_distribution(base_speed, speed_deviation);
-    // X angle - how far from up
-    // Y angle - uniform spread on XZ plane
-    static std::uniform_real_distribution<float> x_angle_distribution(0.f, max_angle), y_angle_distribution(0, TAU);
+    shader->use();
+    upload_model_transforms(shader, frame, glm::mat4(1));
+    glUniform1f(shader->getUniformLocation(UNIFORM_PARTICLE_LIFETIME), lifetime);
+    glUniform1f(shader->getUniformLocation(UNIFORM_INTERPOLATION), snapshot.interpolation);
+    glUniform1f(shader->getUniformLocation(UNIFORM_PARTICLE_SCALE), snapshot.size_scale);
+    glUniform1f(shader->getUniformLocation(UNIFORM_SIZE_GROWTH), particle_max_size_growth);
+    gl_state().bind_vertex_array(vertex_array);
+    glDrawElementsInstanced(GL_TRIANGLES, particle->index_count, GL_UNSIGNED_INT, nullptr, instances);
+}
 
-    std::vector<glm::vec3> velocities;
-    velocities.reserve(n);
+size_t ParticleSystem::step_on_cpu(size_t to_spawn, glm::vec4 emitter)
+{
+    // Ranges of the pool are integrated in parallel, the ones that expired are moved along and dropped below
+    job_system().parallel_for(particles.count, particle_job_chunk, [this](size_t begin, size_t end)
+                              {
+        for (size_t i = begin; i < end; ++i)
+        {
+            particles.lifetimes[i] -= time_step;
+            particles.previous_positions[i] = particles.positions[i];
+            // Move according to particle's velocity
+            particles.positions[i] += particles.velocities[i] * time_step;
+            // Decrease velocity
+            particles.velocities[i] -= drag * particles.velocities[i] * time_step;
+        } });
 
-    for (int i = 0; i < n; ++i)
+    // A retired slot receives the last particle, which hasn't been visited yet, so i stays put
+    for (size_t i = 0; i < particles.count;)
     {
-        float x_angle = x_angle_distribution(generator),
-              y_angle = y_angle_distribution(generator),
-              speed = speed_distribution(generator);
-
-        glm::mat4 velocity_matrix = glm::mat4(1.f);
-        velocity_matrix = glm::rotate(velocity_matrix, x_angle, glm::vec3(right));
-        velocity_matrix = glm::rotate(velocity_matrix, y_angle, glm::vec3(up));
-        glm::vec4 velocity = (up * velocity_matrix) * speed;
-        velocities.push_back(velocity);
+        if (particles.lifetimes[i] < 0)
+            particles.retire(i);
+        else
+            ++i;
     }
 
-    return velocities;
+    if (to_spawn > particles.capacity - particles.count)
+        to_spawn = particles.capacity - particles.count;
+
+    // Create new particles at the end of the pool
+    spawn(particles.count, to_spawn, emitter);
+    particles.count += to_spawn;
+    return to_spawn;
 }
-std::vector<float> generate_random_lifetimes(int n, float base, float deviation)
+
+size_t ParticleSystem::step_on_gpu(size_t to_spawn, glm::vec4 emitter)
 {
-    static std::random_device rng{};
-    static std::mt19937 generator{rng()};
-    static std::uniform_real_distribution<float> distribution(base - deviation, base + deviation);
+    int source = current, target = 1 - current;
 
-    std::vector<float> lifetimes;
-    lifetimes.reserve(n);
+    // Integrate every slot from source into target, nothing is rasterized
+    update_shader->use();
+    glUniform1f(update_shader->getUniformLocation(UNIFORM_DELTA_TIME), time_step);
+    glUniform1f(update_shader->getUniformLocation(UNIFORM_DRAG), drag);
+    gl_state().set_enabled(GL_RASTERIZER_DISCARD, true);
+    gl_state().bind_buffer_base(GL_TRANSFORM_FEEDBACK_BUFFER, 0, state_buffers[target]);
+    gl_state().bind_vertex_array(update_vertex_arrays[source]);
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArrays(GL_POINTS, 0, particles.capacity);
+    glEndTransformFeedback();
+    gl_state().bind_buffer_base(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    gl_state().set_enabled(GL_RASTERIZER_DISCARD, false);
 
-    for (int i = 0; i < n; i++)
+    // New particles are generated into the pool, which only serves as staging here, and overwrite
+    // the oldest ring slots. Slots still alive get replaced early if capacity < spawn_rate * lifetime.
+    if (to_spawn > particles.capacity)
+        to_spawn = particles.capacity;
+    if (to_spawn > 0)
     {
-        lifetimes.push_back(distribution(generator));
+        spawn(0, to_spawn, emitter);
+        frame_vector<ParticleState> spawned(to_spawn);
+        for (size_t i = 0; i < to_spawn; ++i)
+            spawned[i] = ParticleState{particles.positions[i], particles.lifetimes[i], particles.velocities[i]};
+
+        // Into source as well, so the previous position of a new particle is its current one.
+        // The next tick's update pass overwrites all of source anyway.
+        size_t until_end = std::min(to_spawn, particles.capacity - emit_cursor);
+        for (int buffer : {target, source})
+        {
+            gl_state().bind_buffer(GL_ARRAY_BUFFER, state_buffers[buffer]);
+            glBufferSubData(GL_ARRAY_BUFFER, emit_cursor * sizeof(ParticleState), until_end * sizeof(ParticleState), spawned.data());
+            if (until_end < to_spawn)
+                glBufferSubData(GL_ARRAY_BUFFER, 0, (to_spawn - until_end) * sizeof(ParticleState), spawned.data() + until_end);
+        }
+        emit_cursor = (emit_cursor + to_spawn) % particles.capacity;
     }
 
-    return lifetimes;
-}
\ No newline at end of file
+    current = target;
+    return to_spawn;
+}
@@ -1,25 +1,156 @@
 #pragma once
 #include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
 #include <vector>
 
 #include "mesh.h"
 #include "shaderprogram.h"
+#include "frame_uniforms.hpp"
+#include "random_stream.hpp"
+#include "bounds.hpp"
+
+// Per-instance attribute slots of the particle shaders, after the MeshAttribute ones
+enum ParticleAttribute
+{
+    PARTICLE_POSITION = 3,
+    PARTICLE_LIFETIME = 4,
+    PARTICLE_PREVIOUS_POSITION = 5,
+};
+
+// Simulation tick, independent of the frame rate
+#define particle_time_step (1.f / 60)
+// Particles per job when a pool is processed in parallel
+#define particle_job_chunk 4096
+// Ticks run per update at most, time beyond that is dropped instead of stalling the frame
+#define particle_max_steps 8
+// Size a billboard grows to over its life relative to the initial one, sets sizeGrowth in v_billboard.glsl
+#define particle_max_size_growth 2.5f
+// Box-Muller normals from 24 bit uniforms never exceed ~5.8 standard deviations
+#define particle_bound_deviations 6
+
+// Where particles are integrated
+enum ParticleBackend
+{
+    PARTICLES_CPU, // ParticlePool, uploaded every frame
+    PARTICLES_GPU, // Ping-pong state buffers updated with transform feedback
+};
+
+/// One particle slot of the GPU state buffers, laid out like the outputs of v_particle_update.glsl
+struct ParticleState
+{
+    glm::vec3 position;
+    float lifetime; // Remaining, dead slots are <= 0
+    glm::vec3 velocity;
+};
+
+/// Fixed capacity particle storage, one contiguous cache line aligned array per attribute.
+/// Live particles are always packed in [0, count).
+struct ParticlePool
+{
+    explicit ParticlePool(size_t capacity);
+    ~ParticlePool();
+    ParticlePool(const ParticlePool &) = delete;
+    ParticlePool &operator=(const ParticlePool &) = delete;
+
+    /// Removes particle i in O(1) by moving the last one into its slot
+    void retire(size_t i);
+
+    size_t capacity, count;
+    glm::vec3 *positions;
+    glm::vec3 *previous_positions; // Before the last tick, for render interpolation
+    glm::vec3 *velocities;
+    float *lifetimes; // Remaining
+};
+
+/// What drawing needs from an emitter, copied out after its update so the simulation can go on meanwhile.
+/// The vectors keep their capacity between frames.
+struct ParticleSnapshot
+{
+    unsigned long tick = 0; // Changes whenever the instance data does
+    size_t count = 0;
+    float interpolation = 0, size_scale = 1;
+    std::vector<glm::vec3> positions, previous_positions; // CPU backend only
+    std::vector<float> lifetimes;
+    Bounds bounds; // World space, holds every particle drawn from the snapshot
+};
 
 class ParticleSystem
 {
 public:
-    ParticleSystem(glm::vec4 origin, glm::vec3 position_deviation, float spawn_rate, glm::vec4 direction, float max_angle, float initial_speed, float initial_speed_deviation, float drag, float lifetime, float lifetime_deviation, Mesh *particle_model, ShaderProgram *shader);
+    /// capacity - maximum number of live particles, spawning stops while the pool is full
+    ParticleSystem(glm::vec4 origin, glm::vec3 position_deviation, float spawn_rate, glm::vec4 direction, float max_angle, float initial_speed, float initial_speed_deviation, float drag, float lifetime, float lifetime_deviation, Mesh *particle_model, ShaderProgram *shader, size_t capacity);
+    ~ParticleSystem();
 
-    void draw(float deltaTime, glm::mat4 P, glm::mat4 V, glm::mat4 root_object = glm::mat4(1.f));
+    /// Switches to the transform feedback backend, update_shader captures the ParticleState outputs.
+    /// The state buffers are used as a ring: every slot is drawn and new particles replace the oldest ones.
+    void enable_gpu_simulation(ShaderProgram *update_shader);
+
+    /// Advances the simulation by whole ticks, the remainder carries over to the next update.
+    /// The CPU backend makes no GL calls here and can be updated from a job.
+    /// At most spawn_limit particles are emitted, the rest of this update's emission is dropped.
+    void update(float deltaTime, glm::mat4 root_object = glm::mat4(1.f), size_t spawn_limit = SIZE_MAX);
+    /// Copies the state drawing needs, the GPU backend's state stays in its buffers
+    void write_snapshot(ParticleSnapshot &snapshot) const;
+    /// Draws the particles of snapshot interpolated between its last two ticks, needs the GL context
+    void draw(const FrameUniforms &frame, const ParticleSnapshot &snapshot);
+    /// Level of detail - emission_scale multiplies the spawn rate, size_scale the particle size
+    void set_lod(float emission_scale, float size_scale);
+
+    /// Exact for the CPU backend, an estimate from the emission rate for the GPU one
+    size_t get_live_count() const;
+    size_t get_capacity() const { return particles.capacity; }
+    /// Particles the last update wanted to emit and the ones it did
+    size_t get_requested() const { return requested; }
+    size_t get_spawned() const { return spawned; }
+    /// Emission rate after level of detail, per second
+    float get_emission_rate() const { return spawn_rate * emission_scale; }
+    /// Farthest a particle gets from the origin without deviation, bounds the plume
+    float get_reach() const { return initial_speed * lifetime; }
+    /// Same, but with the largest deviations of speed, lifetime and spawn position
+    float get_max_reach() const;
+    ParticleBackend get_backend() const { return backend; }
     ShaderProgram *shader;
 
     const glm::vec4 &get_origin() { return origin; }
+    /// Restarts the emission random stream, systems seeded alike emit identical particles
+    void seed(uint64_t seed);
 
 private:
     glm::vec4 origin, direction;
+    glm::vec3 up, right, forward;
     glm::vec3 position_deviation;
     float spawn_rate, max_angle, initial_speed, initial_speed_deviation, lifetime, lifetime_deviation, drag;
-    std::vector<glm::vec3> particle_positions, particle_velocity;
-    std::vector<float> particle_lifetime_remaining;
+    ParticlePool particles;
+    RandomStream rng;
+    std::vector<float> random_values; // Scratch of spawn()
+    float time_step;
+    float accumulator;       // Simulated time not yet covered by a tick
+    float spawn_accumulator; // Fraction of a particle carried over between ticks
+    unsigned long tick;          // Ticks run so far
+    unsigned long uploaded_tick; // Tick of the snapshot in instance_buffer
+    float emission_scale, size_scale;
+    size_t requested, spawned;
+    // Box of all world space emitter positions so far and the time since emission started,
+    // the GPU backend's bound grows from them since its particles never come back to the CPU
+    glm::vec3 emitter_low, emitter_high;
+    float emitting_time;
     Mesh *particle;
+    // particle's attributes plus the per-instance positions, lifetimes and previous positions
+    GLuint vertex_array, instance_buffer;
+
+    ParticleBackend backend;
+    ShaderProgram *update_shader;
+    GLuint state_buffers[2];
+    GLuint update_vertex_arrays[2]; // Read state_buffers[i] as points
+    GLuint render_vertex_arrays[2]; // particle's attributes plus state_buffers[i] and, as the previous state, state_buffers[1 - i] per instance
+    int current;                    // state buffer holding the latest state
+    size_t emit_cursor;             // Next ring slot to spawn into
+
+    void draw_instances(const FrameUniforms &frame, const ParticleSnapshot &snapshot, GLuint vertex_array, size_t instances);
+    // One tick, up to to_spawn particles are emitted at its end, returns how many were
+    size_t step_on_cpu(size_t to_spawn, glm::vec4 emitter);
+    size_t step_on_gpu(size_t to_spawn, glm::vec4 emitter);
+    // Writes n new particles into the pool starting at first, all random values are generated in one batch
+    void spawn(size_t first, size_t n, glm::vec4 emitter);
 };
\ No newline at end of file
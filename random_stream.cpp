@@ -0,0 +1,58 @@
+#include "random_stream.hpp"
+
+// Expands one 64 bit seed into well mixed state words
+static uint64_t splitmix64(uint64_t &x)
+{
+    uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static inline uint32_t rotl(uint32_t x, int k)
+{
+    return (x << k) | (x >> (32 - k));
+}
+
+RandomStream::RandomStream(uint64_t seed)
+{
+    this->seed(seed);
+}
+
+void RandomStream::seed(uint64_t seed)
+{
+    for (int word = 0; word < 4; ++word)
+        for (int lane = 0; lane < random_lanes; lane += 2)
+        {
+            uint64_t bits = splitmix64(seed);
+            state[word][lane] = (uint32_t)bits;
+            state[word][lane + 1] = (uint32_t)(bits >> 32);
+        }
+}
+
+void RandomStream::fill_uniform(float *out, size_t n)
+{
+    uint32_t(&s)[4][random_lanes] = state;
+    float step[random_lanes];
+
+    for (size_t i = 0; i < n; i += random_lanes)
+    {
+        for (int lane = 0; lane < random_lanes; ++lane)
+        {
+            uint32_t result = s[0][lane] + s[3][lane];
+            uint32_t t = s[1][lane] << 9;
+            s[2][lane] ^= s[0][lane];
+            s[3][lane] ^= s[1][lane];
+            s[1][lane] ^= s[2][lane];
+            s[0][lane] ^= s[3][lane];
+            s[2][lane] ^= t;
+            s[3][lane] = rotl(s[3][lane], 11);
+            // The top 24 bits, the low ones of xoshiro128+ are weak
+            step[lane] = (result >> 8) * (1.f / 16777216.f);
+        }
+
+        // The last step may produce more values than asked for, the rest is dropped
+        for (int lane = 0; lane < random_lanes && i + lane < n; ++lane)
+            out[i + lane] = step[lane];
+    }
+}
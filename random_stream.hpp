@@ -0,0 +1,22 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Independent generators advanced together, fill_uniform produces this many values per step
+#define random_lanes 4
+
+/// Batch random number generator - random_lanes xoshiro128+ generators (Blackman, Vigna) stored lane-major,
+/// so one step of all lanes is plain element-wise integer code the compiler can vectorize.
+/// The same seed always gives the same stream.
+class RandomStream
+{
+public:
+    explicit RandomStream(uint64_t seed);
+
+    void seed(uint64_t seed);
+    /// Writes n uniform floats in [0, 1)
+    void fill_uniform(float *out, size_t n);
+
+private:
+    uint32_t state[4][random_lanes];
+};
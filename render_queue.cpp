@@ -0,0 +1,91 @@
+#include "render_queue.hpp"
+#include "frame_arena.hpp"
+#include "gl_state.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+// Non-negative floats order like their bit patterns
+static uint32_t depth_bits(float depth)
+{
+    depth = std::max(depth, 0.f);
+    uint32_t bits;
+    memcpy(&bits, &depth, sizeof(bits));
+    return bits;
+}
+
+uint64_t make_sort_key(RenderPass pass, GLuint program, GLuint diffuse_texture, GLuint roughness_texture, float depth)
+{
+    uint64_t key = (uint64_t)pass << 62;
+    if (pass == RENDER_TRANSPARENT)
+        return key | (uint64_t)~depth_bits(depth) << 30 | (program & 0xff);
+
+    uint64_t bucket = std::min(63.f, std::max(depth, 0.f) / render_depth_bucket);
+    uint64_t material = (diffuse_texture & 0xff) << 8 | (roughness_texture & 0xff);
+    return key | bucket << 56 | (uint64_t)(program & 0xff) << 48 | material << 32 | depth_bits(depth);
+}
+
+RenderQueue::RenderQueue(size_t capacity, const FrameUniforms &frame) : frame(frame)
+{
+    this->capacity = capacity;
+    count = 0;
+    items = (Item *)frame_arena().allocate(capacity * sizeof(Item), alignof(Item));
+    order = (SortEntry *)frame_arena().allocate(capacity * sizeof(SortEntry), alignof(SortEntry));
+}
+
+void RenderQueue::add_mesh(RenderPass pass, Mesh *mesh, ShaderProgram *program, const glm::mat4 &M, float depth)
+{
+    assert(count < capacity);
+    items[count] = Item{mesh, program, M, nullptr, nullptr};
+    order[count] = SortEntry{make_sort_key(pass, program->getHandle(), mesh->diffuse_texture, mesh->roughness_texture, depth), (uint32_t)count};
+    ++count;
+}
+
+void RenderQueue::add_callback(RenderPass pass, RenderCallback callback, void *data, float depth)
+{
+    assert(count < capacity);
+    items[count] = Item{nullptr, nullptr, glm::mat4(1), callback, data};
+    order[count] = SortEntry{make_sort_key(pass, 0, 0, 0, depth), (uint32_t)count};
+    ++count;
+}
+
+void RenderQueue::submit()
+{
+    std::sort(order, order + count, [](const SortEntry &a, const SortEntry &b)
+              { return a.key < b.key; });
+
+    stats = RenderStats();
+    stats.items = count;
+    // Binds go through gl_state(), which drops the redundant ones. The stats count changes between
+    // consecutive meshes, i.e. how well the sort grouped them.
+    const Item *previous = nullptr;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const Item &item = items[order[i].item];
+        if (item.callback)
+        {
+            stats.draw_calls += item.callback(item.data);
+            continue;
+        }
+
+        if (!previous || item.program != previous->program)
+            ++stats.program_changes;
+        if (!previous || item.mesh->diffuse_texture != previous->mesh->diffuse_texture)
+            ++stats.texture_changes;
+        if (!previous || item.mesh->roughness_texture != previous->mesh->roughness_texture)
+            ++stats.texture_changes;
+        if (!previous || item.mesh->vertex_array != previous->mesh->vertex_array)
+            ++stats.vertex_array_changes;
+        previous = &item;
+
+        item.program->use();
+        item.program->setSampler(UNIFORM_TEX, 0);
+        item.program->setSampler(UNIFORM_ROUGH, 1);
+        gl_state().bind_texture(0, item.mesh->diffuse_texture);
+        gl_state().bind_texture(1, item.mesh->roughness_texture);
+        gl_state().bind_vertex_array(item.mesh->vertex_array);
+
+        item.mesh->draw_bound(item.program, frame, item.M);
+        ++stats.draw_calls;
+    }
+}
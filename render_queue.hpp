@@ -0,0 +1,71 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+
+#include "mesh.h"
+#include "shaderprogram.h"
+#include "frame_uniforms.hpp"
+
+// Opaque items within one bucket of this many units of depth are grouped by state before distance
+#define render_depth_bucket 2.f
+
+/// Passes in submission order
+enum RenderPass
+{
+    RENDER_OPAQUE = 0,      // Front to back, so later fragments fail the depth test early
+    RENDER_WATER = 1,       // After the hull that covers part of it
+    RENDER_TRANSPARENT = 2, // Back to front
+};
+
+/// Draws custom geometry and returns the draw calls it issued. May change any state.
+typedef unsigned (*RenderCallback)(void *data);
+
+struct RenderStats
+{
+    size_t items = 0, draw_calls = 0;
+    size_t program_changes = 0, texture_changes = 0, vertex_array_changes = 0;
+};
+
+/// 64-bit sort key. Opaque: pass | depth bucket | program | material | depth, transparent: pass | inverted depth | program.
+/// depth is the view space distance, handles are truncated to their low bits which only affects grouping.
+uint64_t make_sort_key(RenderPass pass, GLuint program, GLuint diffuse_texture, GLuint roughness_texture, float depth);
+
+/// Draws of one frame, recorded in any order and submitted sorted by key.
+/// State is set through gl_state(), so sorting by key is what keeps the calls reaching GL low.
+/// Items live in the frame arena, so a queue only lasts for one frame.
+class RenderQueue
+{
+public:
+    RenderQueue(size_t capacity, const FrameUniforms &frame);
+
+    /// Mesh drawn with its diffuse texture on unit 0 and roughness on unit 1
+    void add_mesh(RenderPass pass, Mesh *mesh, ShaderProgram *program, const glm::mat4 &M, float depth);
+    void add_callback(RenderPass pass, RenderCallback callback, void *data, float depth = 0);
+    void submit();
+
+    RenderStats get_stats() const { return stats; }
+
+private:
+    struct Item
+    {
+        Mesh *mesh;
+        ShaderProgram *program;
+        glm::mat4 M;
+        RenderCallback callback;
+        void *data;
+    };
+
+    struct SortEntry
+    {
+        uint64_t key;
+        uint32_t item;
+    };
+
+    const FrameUniforms &frame;
+    size_t capacity, count;
+    Item *items;
+    SortEntry *order;
+    RenderStats stats;
+};
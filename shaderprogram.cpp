@@ -1,6 +1,29 @@
 #include "shaderprogram.h"
+#include "frame_uniforms.hpp"
+#include "gl_state.hpp"
 #include <stdio.h>
 
+static const char *uniformNames[UNIFORM_COUNT] = {
+    "M",
+    "MV",
+    "MVP",
+    "normalMatrix",
+    "tex",
+    "rough",
+    "wavePhase",
+    "waveNumber",
+    "levelScale",
+    "levelOffset",
+    "levelExtent",
+    "tileOffset",
+    "deltaTime",
+    "drag",
+    "particleLifetime",
+    "interpolation",
+    "particleScale",
+    "sizeGrowth",
+};
+
 char *ShaderProgram::readFile(const char *filename)
 {
     int filesize;
@@ -86,6 +109,29 @@ ShaderProgram::ShaderProgram(const char *vertexShaderFile, const char *fragmentS
     glAttachShader(shaderProgram, fragmentShader);
     if (geometryShaderFile != NULL)
         glAttachShader(shaderProgram, geometryShader);
+    link();
+}
+
+ShaderProgram::ShaderProgram(const char *vertexShaderFile, const char **feedbackVaryings, int feedbackVaryingCount)
+{
+    // Load vertex shader
+    printf("Loading vertex shader...\n");
+    vertexShader = loadShader(GL_VERTEX_SHADER, vertexShaderFile);
+    geometryShader = 0;
+    fragmentShader = 0;
+
+    // Generate shader program handle
+    shaderProgram = glCreateProgram();
+
+    // Attach the shader, choose the outputs captured into the feedback buffer and link shader program
+    glAttachShader(shaderProgram, vertexShader);
+    glTransformFeedbackVaryings(shaderProgram, feedbackVaryingCount, feedbackVaryings, GL_INTERLEAVED_ATTRIBS);
+    link();
+}
+
+// Links the attached shaders, prints the log and reads active variables
+void ShaderProgram::link()
+{
     glLinkProgram(shaderProgram);
 
     // Download an error log and display it
@@ -103,6 +149,8 @@ ShaderProgram::ShaderProgram(const char *vertexShaderFile, const char *fragmentS
         delete[] infoLog;
     }
 
+    readActiveVariables();
+
     printf("Shader program created \n");
 }
 
@@ -112,32 +160,97 @@ ShaderProgram::~ShaderProgram()
     glDetachShader(shaderProgram, vertexShader);
     if (geometryShader != 0)
         glDetachShader(shaderProgram, geometryShader);
-    glDetachShader(shaderProgram, fragmentShader);
+    if (fragmentShader != 0)
+        glDetachShader(shaderProgram, fragmentShader);
 
     // Delete shaders
     glDeleteShader(vertexShader);
     if (geometryShader != 0)
         glDeleteShader(geometryShader);
-    glDeleteShader(fragmentShader);
+    if (fragmentShader != 0)
+        glDeleteShader(fragmentShader);
 
     // Delete program
-    glDeleteProgram(shaderProgram);
+    gl_state().delete_program(shaderProgram);
 }
 
 // Make the shader program active
 void ShaderProgram::use()
 {
-    glUseProgram(shaderProgram);
+    gl_state().use_program(shaderProgram);
+}
+
+// Uniform values belong to the program, so the program remembers which unit each sampler reads
+void ShaderProgram::setSampler(ShaderUniform uniform, GLint unit)
+{
+    if (uniformLocations[uniform] == -1)
+        return;
+#if gl_state_filtering
+    if (samplerUnits[uniform] == unit)
+    {
+        gl_state().count(false);
+        return;
+    }
+#endif
+    samplerUnits[uniform] = unit;
+    glUniform1i(uniformLocations[uniform], unit);
+    gl_state().count(true);
+}
+
+// Query every active uniform and attribute once, so that draws never ask the driver by name
+void ShaderProgram::readActiveVariables()
+{
+    GLint count = 0, maxLength = 0;
+    GLint size;
+    GLenum type;
+
+    glGetProgramiv(shaderProgram, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(shaderProgram, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+    char *name = new char[maxLength + 1];
+    for (GLint i = 0; i < count; ++i)
+    {
+        glGetActiveUniform(shaderProgram, i, maxLength + 1, NULL, &size, &type, name);
+        std::string uniformName = name;
+        // Arrays are reported as name[0], keep them reachable by their plain name too
+        if (uniformName.size() > 3 && uniformName.compare(uniformName.size() - 3, 3, "[0]") == 0)
+            uniformName.resize(uniformName.size() - 3);
+        uniforms[uniformName] = glGetUniformLocation(shaderProgram, name);
+    }
+    delete[] name;
+
+    glGetProgramiv(shaderProgram, GL_ACTIVE_ATTRIBUTES, &count);
+    glGetProgramiv(shaderProgram, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+    name = new char[maxLength + 1];
+    for (GLint i = 0; i < count; ++i)
+    {
+        glGetActiveAttrib(shaderProgram, i, maxLength + 1, NULL, &size, &type, name);
+        attributes[name] = glGetAttribLocation(shaderProgram, name);
+    }
+    delete[] name;
+
+    // Camera and lights shared by all programs
+    GLuint frameBlock = glGetUniformBlockIndex(shaderProgram, "Frame");
+    if (frameBlock != GL_INVALID_INDEX)
+        glUniformBlockBinding(shaderProgram, frameBlock, frame_block_binding);
+
+    for (int i = 0; i < UNIFORM_COUNT; ++i)
+    {
+        auto found = uniforms.find(uniformNames[i]);
+        uniformLocations[i] = found == uniforms.end() ? -1 : found->second;
+        samplerUnits[i] = -1;
+    }
 }
 
 // Get the slot number corresponding to the uniform variableName
 GLuint ShaderProgram::getUniformLocation(const char *variableName)
 {
-    return glGetUniformLocation(shaderProgram, variableName);
+    auto found = uniforms.find(variableName);
+    return found == uniforms.end() ? -1 : found->second;
 }
 
 // Get the slot number corresponding to the attribute variableName
 GLuint ShaderProgram::getAttributeLocation(const char *variableName)
 {
-    return glGetAttribLocation(shaderProgram, variableName);
+    auto found = attributes.find(variableName);
+    return found == attributes.end() ? -1 : found->second;
 }
@@ -1,5 +1,31 @@
 #pragma once
 #include <GL/glew.h>
+#include <string>
+#include <unordered_map>
+
+// Uniforms used on the draw paths, resolved once after linking
+enum ShaderUniform
+{
+    UNIFORM_M,
+    UNIFORM_MV,
+    UNIFORM_MVP,
+    UNIFORM_NORMAL_MATRIX,
+    UNIFORM_TEX,
+    UNIFORM_ROUGH,
+    UNIFORM_WAVE_PHASE,
+    UNIFORM_WAVE_NUMBER,
+    UNIFORM_LEVEL_SCALE,
+    UNIFORM_LEVEL_OFFSET,
+    UNIFORM_LEVEL_EXTENT,
+    UNIFORM_TILE_OFFSET,
+    UNIFORM_DELTA_TIME,
+    UNIFORM_DRAG,
+    UNIFORM_PARTICLE_LIFETIME,
+    UNIFORM_INTERPOLATION,
+    UNIFORM_PARTICLE_SCALE,
+    UNIFORM_SIZE_GROWTH,
+    UNIFORM_COUNT
+};
 
 class ShaderProgram
 {
@@ -10,10 +36,20 @@ private:
     GLuint fragmentShader;                                      // Fragment shader handle
     char *readFile(const char *filename);                       // File reading method
     GLuint loadShader(GLenum shaderType, const char *fileName); // Reads shader source file, compiles it and returns the corresponding handle
+    std::unordered_map<std::string, GLint> uniforms;            // Active uniform locations by name
+    std::unordered_map<std::string, GLint> attributes;          // Active attribute locations by name
+    GLint uniformLocations[UNIFORM_COUNT];                      // Locations of the ShaderUniform values, -1 if inactive
+    GLint samplerUnits[UNIFORM_COUNT];                          // Texture units last assigned by setSampler, -1 if never
+    void readActiveVariables();                                 // Fills the location tables from the linked program
+    void link();                                                // Links the program and reports errors
 public:
     ShaderProgram(const char *vertexShaderFile, const char *fragmentShaderFile, const char *geometryShaderFile = NULL);
+    ShaderProgram(const char *vertexShaderFile, const char **feedbackVaryings, int feedbackVaryingCount); // Vertex-only program whose outputs are captured with transform feedback
     ~ShaderProgram();
-    void use();                                            // Turns on the shader program
+    void use();                                            // Turns on the shader program, skipped if it is on already
+    void setSampler(ShaderUniform uniform, GLint unit);    // Points a sampler uniform at a texture unit, the program has to be in use
     GLuint getUniformLocation(const char *variableName);   // Returns the slot number corresponding to the uniform variableName
     GLuint getAttributeLocation(const char *variableName); // Returns the slot number corresponding to the attribute variableName
+    GLint getUniformLocation(ShaderUniform uniform) const { return uniformLocations[uniform]; } // Pre-resolved slot number, no lookup
+    GLuint getHandle() const { return shaderProgram; }                                          // Program object, e.g. for sorting draws
 };
\ No newline at end of file
@@ -0,0 +1,39 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+
+/// Bounded lock-free queue for one producer and one consumer thread. capacity has to be a power of two.
+template <typename T, size_t capacity>
+class SpscQueue
+{
+    static_assert((capacity & (capacity - 1)) == 0, "capacity has to be a power of two");
+
+public:
+    /// False if the queue is full
+    bool push(const T &item)
+    {
+        size_t tail = this->tail.load(std::memory_order_relaxed);
+        if (tail - head.load(std::memory_order_acquire) == capacity)
+            return false;
+        items[tail & (capacity - 1)] = item;
+        this->tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// False if the queue is empty
+    bool pop(T &item)
+    {
+        size_t head = this->head.load(std::memory_order_relaxed);
+        if (head == tail.load(std::memory_order_acquire))
+            return false;
+        item = items[head & (capacity - 1)];
+        this->head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    T items[capacity];
+    // Producer and consumer indices on their own cache lines
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+};
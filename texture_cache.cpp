@@ -0,0 +1,207 @@
+#include "texture_cache.hpp"
+#include "gl_state.hpp"
+#include <lodepng.h>
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <filesystem>
+#include <tuple>
+#include <vector>
+
+bool TextureSampler::operator<(const TextureSampler &other) const
+{
+    return std::tie(wrap, mipmaps, anisotropy) < std::tie(other.wrap, other.mipmaps, other.anisotropy);
+}
+
+TextureCache::~TextureCache()
+{
+    if (!entries.empty())
+        printf("%zu textures still referenced at exit\n", entries.size());
+}
+
+// Different spellings of one file share an entry, paths that can't be resolved are used as they are
+TextureCache::Key TextureCache::make_key(const std::string &path, const TextureSampler &sampler)
+{
+    std::error_code error;
+    std::filesystem::path canonical = std::filesystem::weakly_canonical(path, error);
+    return Key(error ? path : canonical.string(), sampler);
+}
+
+GLuint TextureCache::find(const std::string &path, const TextureSampler &sampler)
+{
+    auto found = entries.find(make_key(path, sampler));
+    if (found == entries.end())
+        return 0;
+    ++found->second.references;
+    return found->second.texture;
+}
+
+GLuint TextureCache::acquire(const std::string &path, const TextureSampler &sampler)
+{
+    if (GLuint texture = find(path, sampler))
+        return texture;
+
+    MipChain chain;
+    if (unsigned error = lodepng::decode(chain.pixels, chain.width, chain.height, path))
+    {
+        printf("LODEPNG ERROR %u %s\n", error, path.c_str());
+        return 0;
+    }
+    if (sampler.mipmaps)
+        build_mip_chain(chain);
+    else
+        chain.levels = 1;
+    return insert(path, sampler, chain.width, chain.height, chain.levels, chain.pixels.data());
+}
+
+GLuint TextureCache::create_texture(unsigned levels, const TextureSampler &sampler)
+{
+    GLuint texture;
+    glGenTextures(1, &texture);
+    gl_state().bind_texture(0, texture);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, sampler.mipmaps && levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, sampler.wrap);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, sampler.wrap);
+    if (GLEW_EXT_texture_filter_anisotropic && sampler.anisotropy > 1)
+    {
+        GLfloat max_anisotropy;
+        glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &max_anisotropy);
+        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, std::min(sampler.anisotropy, max_anisotropy));
+    }
+    return texture;
+}
+
+GLuint TextureCache::create_storage(unsigned width, unsigned height, unsigned levels, const TextureSampler &sampler)
+{
+    GLuint texture = create_texture(levels, sampler);
+    for (unsigned level = 0; level < levels; ++level)
+        glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, std::max(1u, width >> level), std::max(1u, height >> level), 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    return texture;
+}
+
+bool TextureCache::is_supported(TextureFormat format)
+{
+    switch (format)
+    {
+    case TEXTURE_BC1:
+    case TEXTURE_BC3:
+        return GLEW_EXT_texture_compression_s3tc;
+    case TEXTURE_BC4:
+        // Core since 3.0, the extension is checked for drivers that only expose it that way
+        return GLEW_VERSION_3_0 || GLEW_ARB_texture_compression_rgtc;
+    default:
+        return true;
+    }
+}
+
+static GLenum compressed_internal_format(TextureFormat format)
+{
+    switch (format)
+    {
+    case TEXTURE_BC1:
+        return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case TEXTURE_BC3:
+        return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    default:
+        return GL_COMPRESSED_RED_RGTC1;
+    }
+}
+
+GLuint TextureCache::insert(const std::string &path, const TextureSampler &sampler, unsigned width, unsigned height, unsigned levels, const unsigned char *pixels)
+{
+    GLuint texture = create_storage(width, height, levels, sampler);
+    for (unsigned level = 0; level < levels; ++level)
+    {
+        unsigned level_width = std::max(1u, width >> level), level_height = std::max(1u, height >> level);
+        glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, level_width, level_height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+        pixels += (size_t)level_width * level_height * 4;
+    }
+    adopt(path, sampler, texture, mip_chain_size(width, height, levels));
+    return texture;
+}
+
+GLuint TextureCache::insert(const std::string &path, const TextureSampler &sampler, TextureFormat format, unsigned width, unsigned height, unsigned levels, const unsigned char *data)
+{
+    if (format == TEXTURE_RGBA8)
+        return insert(path, sampler, width, height, levels, data);
+
+    if (!is_supported(format))
+    {
+        // Decoded once here, sampled as RGBA8 from then on
+        std::vector<unsigned char> pixels(mip_chain_size(width, height, levels));
+        unsigned char *level_pixels = pixels.data();
+        for (unsigned level = 0; level < levels; ++level)
+        {
+            unsigned level_width = std::max(1u, width >> level), level_height = std::max(1u, height >> level);
+            decompress_texture(format, data, level_width, level_height, level_pixels);
+            data += texture_level_size(format, level_width, level_height);
+            level_pixels += (size_t)level_width * level_height * 4;
+        }
+        return insert(path, sampler, width, height, levels, pixels.data());
+    }
+
+    GLuint texture = create_texture(levels, sampler);
+    for (unsigned level = 0; level < levels; ++level)
+    {
+        unsigned level_width = std::max(1u, width >> level), level_height = std::max(1u, height >> level);
+        size_t size = texture_level_size(format, level_width, level_height);
+        glCompressedTexImage2D(GL_TEXTURE_2D, level, compressed_internal_format(format), level_width, level_height, 0, size, data);
+        data += size;
+    }
+    if (format == TEXTURE_BC4)
+    {
+        // Single channel maps are sampled as grey with opaque alpha, like the RGBA8 images they came from
+        const GLint swizzle[4] = {GL_RED, GL_RED, GL_RED, GL_ONE};
+        glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+    }
+    adopt(path, sampler, texture, texture_chain_size(format, width, height, levels));
+    return texture;
+}
+
+void TextureCache::adopt(const std::string &path, const TextureSampler &sampler, GLuint texture, size_t bytes)
+{
+    Key key = make_key(path, sampler);
+    // Callers look the texture up before creating it
+    assert(!entries.count(key));
+
+    entries[key] = Entry{texture, 1, bytes};
+    keys[texture] = key;
+    resident_bytes += bytes;
+}
+
+void TextureCache::retain(GLuint texture)
+{
+    auto key = keys.find(texture);
+    if (key != keys.end())
+        ++entries[key->second].references;
+}
+
+void TextureCache::release(GLuint texture)
+{
+    auto key = keys.find(texture);
+    if (key == keys.end())
+        return;
+
+    auto entry = entries.find(key->second);
+    if (--entry->second.references > 0)
+        return;
+
+    resident_bytes -= entry->second.bytes;
+    gl_state().delete_textures(1, &texture);
+    entries.erase(entry);
+    keys.erase(key);
+}
+
+void TextureCache::print_resident() const
+{
+    printf("Textures: %zu resident, %.1f MB\n", entries.size(), resident_bytes / (1024.0 * 1024.0));
+}
+
+TextureCache &texture_cache()
+{
+    static TextureCache cache;
+    return cache;
+}
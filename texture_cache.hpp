@@ -0,0 +1,75 @@
+#pragma once
+#include <GL/glew.h>
+#include <cstddef>
+#include <map>
+#include <string>
+
+#include "mip_chain.hpp"
+#include "texture_compression.hpp"
+
+// Upper limit of anisotropic filtering, clamped to what the driver supports
+#define texture_anisotropy 8.f
+
+/// How a texture is sampled, part of the cache key since the settings live in the texture object
+struct TextureSampler
+{
+    GLint wrap = GL_REPEAT;
+    bool mipmaps = true;               // Trilinear filtering over the full chain, otherwise level 0 only
+    float anisotropy = texture_anisotropy; // 1 turns it off
+
+    bool operator<(const TextureSampler &other) const;
+};
+
+/// Reference counted textures keyed by canonical path and sampler, so every file is uploaded once.
+/// Textures are loaded with their full mip chain. GL thread only.
+class TextureCache
+{
+public:
+    /// Runs after the context is gone, only reports textures that were never released
+    ~TextureCache();
+
+    /// Texture for path with one more reference, decoded and uploaded here on first use
+    GLuint acquire(const std::string &path, const TextureSampler &sampler = TextureSampler());
+    /// Same, but returns 0 instead of loading a texture that isn't cached
+    GLuint find(const std::string &path, const TextureSampler &sampler = TextureSampler());
+    /// Uploads levels consecutive RGBA8 levels and caches them with one reference
+    GLuint insert(const std::string &path, const TextureSampler &sampler, unsigned width, unsigned height, unsigned levels, const unsigned char *pixels);
+    /// Same for levels in format. Block formats are uploaded as they are if the driver supports them and decoded to RGBA8 otherwise.
+    GLuint insert(const std::string &path, const TextureSampler &sampler, TextureFormat format, unsigned width, unsigned height, unsigned levels, const unsigned char *data);
+    /// Caches a texture created by create_storage and filled by the caller, with one reference
+    void adopt(const std::string &path, const TextureSampler &sampler, GLuint texture, size_t bytes);
+
+    void retain(GLuint texture);
+    /// Drops a reference, the texture is deleted with the last one. Textures the cache doesn't know, like 0, are ignored.
+    void release(GLuint texture);
+
+    size_t get_resident_bytes() const { return resident_bytes; }
+    size_t get_texture_count() const { return entries.size(); }
+    void print_resident() const;
+
+    /// Texture object with uninitialized RGBA8 levels and the sampler settings applied, bound to GL_TEXTURE_2D
+    static GLuint create_storage(unsigned width, unsigned height, unsigned levels, const TextureSampler &sampler);
+    /// True if levels in format can be uploaded without decoding them first
+    static bool is_supported(TextureFormat format);
+
+private:
+    typedef std::pair<std::string, TextureSampler> Key;
+
+    struct Entry
+    {
+        GLuint texture;
+        int references;
+        size_t bytes;
+    };
+
+    std::map<Key, Entry> entries;
+    std::map<GLuint, Key> keys;
+    size_t resident_bytes = 0;
+
+    static Key make_key(const std::string &path, const TextureSampler &sampler);
+    /// Texture object with no levels yet, bound to GL_TEXTURE_2D
+    static GLuint create_texture(unsigned levels, const TextureSampler &sampler);
+};
+
+/// Shared by the whole program, textures still referenced at exit are reported
+TextureCache &texture_cache();
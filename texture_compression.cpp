@@ -0,0 +1,277 @@
+#include "texture_compression.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+static unsigned block_bytes(TextureFormat format)
+{
+    switch (format)
+    {
+    case TEXTURE_BC1:
+    case TEXTURE_BC4:
+        return 8;
+    case TEXTURE_BC3:
+        return 16;
+    default:
+        return 0;
+    }
+}
+
+size_t texture_level_size(TextureFormat format, unsigned width, unsigned height)
+{
+    if (format == TEXTURE_RGBA8)
+        return (size_t)width * height * 4;
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * block_bytes(format);
+}
+
+size_t texture_chain_size(TextureFormat format, unsigned width, unsigned height, unsigned levels)
+{
+    size_t size = 0;
+    for (unsigned level = 0; level < levels; ++level)
+        size += texture_level_size(format, std::max(1u, width >> level), std::max(1u, height >> level));
+    return size;
+}
+
+TextureFormat choose_color_format(const unsigned char *rgba, unsigned width, unsigned height)
+{
+    for (size_t i = 0; i < (size_t)width * height; ++i)
+        if (rgba[i * 4 + 3] != 255)
+            return TEXTURE_BC3;
+    return TEXTURE_BC1;
+}
+
+// Texels of the block at (x, y), edges repeat the last row and column
+static void load_block(const unsigned char *rgba, unsigned width, unsigned height, unsigned x, unsigned y, unsigned char block[16][4])
+{
+    for (unsigned j = 0; j < 4; ++j)
+        for (unsigned i = 0; i < 4; ++i)
+        {
+            size_t texel = (size_t)std::min(y + j, height - 1) * width + std::min(x + i, width - 1);
+            memcpy(block[j * 4 + i], &rgba[texel * 4], 4);
+        }
+}
+
+static void store_block(unsigned char *rgba, unsigned width, unsigned height, unsigned x, unsigned y, const unsigned char block[16][4])
+{
+    for (unsigned j = 0; j < 4 && y + j < height; ++j)
+        for (unsigned i = 0; i < 4 && x + i < width; ++i)
+            memcpy(&rgba[((size_t)(y + j) * width + x + i) * 4], block[j * 4 + i], 4);
+}
+
+static uint16_t pack_565(const int color[3])
+{
+    return (uint16_t)(((color[0] * 31 + 127) / 255) << 11 | ((color[1] * 63 + 127) / 255) << 5 | (color[2] * 31 + 127) / 255);
+}
+
+static void unpack_565(uint16_t packed, int color[3])
+{
+    color[0] = (packed >> 11) * 255 / 31;
+    color[1] = (packed >> 5 & 63) * 255 / 63;
+    color[2] = (packed & 31) * 255 / 31;
+}
+
+// Colors of a BC1 block, four_colors is forced in BC3 where the ordering of the endpoints carries no meaning
+static void color_palette(uint16_t color0, uint16_t color1, bool four_colors, int palette[4][4])
+{
+    unpack_565(color0, palette[0]);
+    unpack_565(color1, palette[1]);
+    palette[0][3] = palette[1][3] = 255;
+    for (int c = 0; c < 3; ++c)
+        if (four_colors)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        else
+        {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+        }
+    palette[2][3] = 255;
+    palette[3][3] = four_colors ? 255 : 0;
+}
+
+// Endpoints span the bounding box along the diagonal that follows the colors' correlation, inset by 1/16 against outliers
+static void encode_color_block(const unsigned char block[16][4], unsigned char *out)
+{
+    int low[3] = {255, 255, 255}, high[3] = {0, 0, 0}, mean[3] = {0, 0, 0};
+    for (int t = 0; t < 16; ++t)
+        for (int c = 0; c < 3; ++c)
+        {
+            low[c] = std::min(low[c], (int)block[t][c]);
+            high[c] = std::max(high[c], (int)block[t][c]);
+            mean[c] += block[t][c];
+        }
+
+    int covariance[3] = {0, 0, 0}; // Of red with red, green and blue
+    for (int t = 0; t < 16; ++t)
+        for (int c = 1; c < 3; ++c)
+            covariance[c] += (block[t][0] * 16 - mean[0]) * (block[t][c] * 16 - mean[c]);
+    for (int c = 1; c < 3; ++c)
+        if (covariance[c] < 0)
+            std::swap(low[c], high[c]);
+
+    for (int c = 0; c < 3; ++c)
+    {
+        int inset = (high[c] - low[c]) / 16;
+        high[c] -= inset;
+        low[c] += inset;
+    }
+
+    uint16_t color0 = pack_565(high), color1 = pack_565(low);
+    if (color0 < color1)
+        std::swap(color0, color1);
+
+    uint32_t indices = 0;
+    if (color0 != color1)
+    {
+        int palette[4][4];
+        color_palette(color0, color1, true, palette);
+        for (int t = 0; t < 16; ++t)
+        {
+            int best = 0, best_distance = 1 << 30;
+            for (int p = 0; p < 4; ++p)
+            {
+                int distance = 0;
+                for (int c = 0; c < 3; ++c)
+                    distance += (block[t][c] - palette[p][c]) * (block[t][c] - palette[p][c]);
+                if (distance < best_distance)
+                {
+                    best_distance = distance;
+                    best = p;
+                }
+            }
+            indices |= (uint32_t)best << (2 * t);
+        }
+    }
+
+    memcpy(out, &color0, 2);
+    memcpy(out + 2, &color1, 2);
+    memcpy(out + 4, &indices, 4);
+}
+
+static void decode_color_block(const unsigned char *in, bool force_four_colors, unsigned char block[16][4])
+{
+    uint16_t color0, color1;
+    uint32_t indices;
+    memcpy(&color0, in, 2);
+    memcpy(&color1, in + 2, 2);
+    memcpy(&indices, in + 4, 4);
+
+    int palette[4][4];
+    color_palette(color0, color1, force_four_colors || color0 > color1, palette);
+    for (int t = 0; t < 16; ++t)
+        for (int c = 0; c < 4; ++c)
+            block[t][c] = palette[indices >> (2 * t) & 3][c];
+}
+
+// Eight values interpolated between the extremes of one channel, as in BC3 alpha and BC4
+static void encode_channel_block(const unsigned char block[16][4], int channel, unsigned char *out)
+{
+    int low = 255, high = 0;
+    for (int t = 0; t < 16; ++t)
+    {
+        low = std::min(low, (int)block[t][channel]);
+        high = std::max(high, (int)block[t][channel]);
+    }
+
+    uint64_t indices = 0;
+    if (high != low)
+        for (int t = 0; t < 16; ++t)
+        {
+            // Nearest of the 8 steps from high (code 0) through the 6 interpolated values to low (code 1)
+            int step = ((high - block[t][channel]) * 7 + (high - low) / 2) / (high - low);
+            int code = step == 0 ? 0 : step == 7 ? 1 : step + 1;
+            indices |= (uint64_t)code << (3 * t);
+        }
+
+    out[0] = high;
+    out[1] = low;
+    for (int i = 0; i < 6; ++i)
+        out[2 + i] = indices >> (8 * i) & 0xff;
+}
+
+static void decode_channel_block(const unsigned char *in, int channel, unsigned char block[16][4])
+{
+    int values[8] = {in[0], in[1]};
+    for (int i = 2; i < 8; ++i)
+        if (in[0] > in[1])
+            values[i] = ((8 - i) * in[0] + (i - 1) * in[1]) / 7;
+        else
+            values[i] = i < 6 ? ((6 - i) * in[0] + (i - 1) * in[1]) / 5 : i == 6 ? 0 : 255;
+
+    uint64_t indices = 0;
+    for (int i = 0; i < 6; ++i)
+        indices |= (uint64_t)in[2 + i] << (8 * i);
+    for (int t = 0; t < 16; ++t)
+        block[t][channel] = values[indices >> (3 * t) & 7];
+}
+
+void compress_texture(TextureFormat format, const unsigned char *rgba, unsigned width, unsigned height, unsigned char *blocks)
+{
+    if (format == TEXTURE_RGBA8)
+    {
+        memcpy(blocks, rgba, texture_level_size(format, width, height));
+        return;
+    }
+
+    unsigned char block[16][4];
+    for (unsigned y = 0; y < height; y += 4)
+        for (unsigned x = 0; x < width; x += 4)
+        {
+            load_block(rgba, width, height, x, y, block);
+            switch (format)
+            {
+            case TEXTURE_BC1:
+                encode_color_block(block, blocks);
+                break;
+            case TEXTURE_BC3:
+                encode_channel_block(block, 3, blocks);
+                encode_color_block(block, blocks + 8);
+                break;
+            case TEXTURE_BC4:
+                encode_channel_block(block, 0, blocks);
+                break;
+            default:
+                break;
+            }
+            blocks += block_bytes(format);
+        }
+}
+
+void decompress_texture(TextureFormat format, const unsigned char *blocks, unsigned width, unsigned height, unsigned char *rgba)
+{
+    if (format == TEXTURE_RGBA8)
+    {
+        memcpy(rgba, blocks, texture_level_size(format, width, height));
+        return;
+    }
+
+    unsigned char block[16][4];
+    for (unsigned y = 0; y < height; y += 4)
+        for (unsigned x = 0; x < width; x += 4)
+        {
+            switch (format)
+            {
+            case TEXTURE_BC1:
+                decode_color_block(blocks, false, block);
+                break;
+            case TEXTURE_BC3:
+                decode_color_block(blocks + 8, true, block);
+                decode_channel_block(blocks, 3, block);
+                break;
+            case TEXTURE_BC4:
+                decode_channel_block(blocks, 0, block);
+                for (int t = 0; t < 16; ++t)
+                {
+                    block[t][1] = block[t][2] = block[t][0];
+                    block[t][3] = 255;
+                }
+                break;
+            default:
+                break;
+            }
+            store_block(rgba, width, height, x, y, block);
+            blocks += block_bytes(format);
+        }
+}
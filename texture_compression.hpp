@@ -0,0 +1,23 @@
+#pragma once
+#include <cstddef>
+
+/// Texel layout of a texture level. The block formats store 4x4 texel blocks, partial blocks on the edges are padded.
+enum TextureFormat
+{
+    TEXTURE_RGBA8 = 0,
+    TEXTURE_BC1 = 1, // 8 bytes per block, opaque RGB
+    TEXTURE_BC3 = 2, // 16 bytes per block, BC1 colors with an interpolated alpha block
+    TEXTURE_BC4 = 3, // 8 bytes per block, single channel, taken from red
+};
+
+size_t texture_level_size(TextureFormat format, unsigned width, unsigned height);
+/// Bytes of the first levels of a width x height chain
+size_t texture_chain_size(TextureFormat format, unsigned width, unsigned height, unsigned levels);
+
+/// BC3 if any texel isn't opaque, BC1 otherwise
+TextureFormat choose_color_format(const unsigned char *rgba, unsigned width, unsigned height);
+
+/// Encodes an RGBA8 level into texture_level_size(format, width, height) bytes of blocks
+void compress_texture(TextureFormat format, const unsigned char *rgba, unsigned width, unsigned height, unsigned char *blocks);
+/// Decodes blocks back to RGBA8, BC4 as (r, r, r, 1) the same way the GL swizzle shows it
+void decompress_texture(TextureFormat format, const unsigned char *blocks, unsigned width, unsigned height, unsigned char *rgba);
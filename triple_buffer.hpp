@@ -0,0 +1,35 @@
+#pragma once
+#include <atomic>
+
+/// Lock-free hand-off of whole snapshots from one producer to one consumer thread.
+/// The producer fills write_buffer() and publishes it, the consumer acquires the latest published one.
+/// Neither side ever waits: the third buffer is the one in flight, snapshots not acquired in time are skipped.
+template <typename T>
+class TripleBuffer
+{
+public:
+    T &write_buffer() { return buffers[write_index]; }
+    const T &read_buffer() const { return buffers[read_index]; }
+
+    /// Makes the write buffer the latest snapshot and continues writing into the one in flight
+    void publish()
+    {
+        write_index = middle.exchange(write_index | fresh, std::memory_order_acq_rel) & index_mask;
+    }
+
+    /// Switches read_buffer() to the latest snapshot, false if nothing was published since the last call
+    bool acquire()
+    {
+        if (!(middle.load(std::memory_order_relaxed) & fresh))
+            return false;
+        read_index = middle.exchange(read_index, std::memory_order_acq_rel) & index_mask;
+        return true;
+    }
+
+private:
+    static const int fresh = 4, index_mask = 3;
+
+    T buffers[3];
+    int write_index = 0, read_index = 1;
+    std::atomic<int> middle{2}; // Index of the buffer in flight, plus fresh once published
+};
@@ -0,0 +1,52 @@
+#version 330
+
+//Uniform variables
+uniform float particleLifetime; //base lifetime of the emitter
+uniform float sizeGrowth; //size at the end of the life relative to the initial one, particle_max_size_growth
+uniform float interpolation; //how far the frame is between the last two simulation steps
+uniform float particleScale = 1; //level of detail size factor of the emitter
+
+//Shared by all draws of the frame, see FrameUniforms
+layout (std140) uniform Frame {
+    mat4 P;
+    mat4 V;
+    mat4 VP;
+    vec4 cameraPosition;
+    vec4 lightPosition;
+    vec4 redLightSource;
+};
+
+//Attributes
+layout (location=0) in vec4 vertex; //quad corner, xy is the offset from the centre in view space
+layout (location=2) in vec2 texCoord; //quad corner in [0, 1]^2
+layout (location=3) in vec3 instancePosition; //particle position in world space, one per instance
+layout (location=4) in float instanceLifetime; //remaining lifetime, dead particles are <= 0
+layout (location=5) in vec3 instancePreviousPosition; //particle position one simulation step earlier
+
+//View space
+out vec3 lightDir;
+out vec2 corner; //[-1, 1]^2, the unit sphere's silhouette is the inscribed circle
+out float radius;
+out float alpha;
+
+void main(void) {
+    if (instanceLifetime <= 0) {
+        //Outside of the clip volume, the whole instance is clipped
+        gl_Position = vec4(2, 2, 2, 1);
+        return;
+    }
+
+    //Grows and fades out with age
+    float age = clamp(1 - instanceLifetime/particleLifetime, 0, 1);
+    float size = mix(1, sizeGrowth, age)*particleScale;
+    alpha = 1 - age;
+
+    //Expanded in view space so the quad always faces the camera
+    vec3 position = mix(instancePreviousPosition, instancePosition, interpolation);
+    vec4 viewPosition = V*vec4(position, 1)+vec4(vertex.xy*size, 0, 0);
+    gl_Position = P*viewPosition;
+
+    corner = texCoord*2-1;
+    radius = abs(vertex.x)*size;
+    lightDir = (V*redLightSource-viewPosition).xyz;
+}
@@ -1,16 +1,23 @@
 #version 330
 
 //Uniform variables
-uniform mat4 P;
-uniform mat4 V;
 uniform mat4 M;
-
-
-uniform vec4 lightPosition;
+uniform mat4 MVP;
+uniform mat3 normalMatrix; //inverse(transpose(mat3(M)))
+
+//Shared by all draws of the frame, see FrameUniforms
+layout (std140) uniform Frame {
+    mat4 P;
+    mat4 V;
+    mat4 VP;
+    vec4 cameraPosition;
+    vec4 lightPosition;
+    vec4 redLightSource;
+};
 
 //Attributes
 layout (location=0) in vec4 vertex; //vertex coordinates in model space
-layout (location=1) in vec4 normal; //vertex normal vector in model space
+layout (location=1) in vec2 normal; //vertex normal vector in model space, octahedral-encoded
 layout (location=2) in vec2 texCoord; //texturing coordinates
 
 
@@ -20,14 +27,22 @@ out vec4 i_normal;
 out vec4 halfway;
 out vec4 light;
 
+// Unfolds an octahedral-encoded unit vector
+vec3 decodeNormal(vec2 e) {
+    vec3 n = vec3(e, 1 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0);
+    n.xy += vec2(n.x >= 0 ? -t : t, n.y >= 0 ? -t : t);
+    return normalize(n);
+}
+
 void main(void) {
-    gl_Position=P*V*M*vertex;
+    gl_Position=MVP*vertex;
 
-    vec4 viewer = inverse(V)*(vec4(0,0,0,1)-V*M*vertex);
-    vec4 lightDir = lightPosition - M*vertex;
+    vec4 worldPosition = M*vertex;
+    vec4 viewer = cameraPosition - worldPosition;
+    vec4 lightDir = lightPosition - worldPosition;
 
-    mat4 G=mat4(inverse(transpose(mat3(M))));
-    i_normal = G*normal;
+    i_normal = vec4(normalMatrix*decodeNormal(normal), 0);
     halfway = (lightDir+viewer)/length(lightDir+viewer);
 
     light = lightDir;
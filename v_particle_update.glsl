@@ -0,0 +1,29 @@
+#version 330
+
+//Uniform variables
+uniform float deltaTime;
+uniform float drag;
+
+//Attributes, one vertex per particle slot
+layout (location=0) in vec3 position; //world space
+layout (location=1) in float lifetime; //remaining, dead slots are <= 0
+layout (location=2) in vec3 velocity; //world space
+
+//Captured with transform feedback, in the same order as ParticleState
+out vec3 outPosition;
+out float outLifetime;
+out vec3 outVelocity;
+
+void main(void) {
+    outLifetime = lifetime-deltaTime;
+    if (outLifetime < 0) {
+        outPosition = position;
+        outVelocity = velocity;
+        return;
+    }
+
+    // Move according to particle's velocity
+    outPosition = position+velocity*deltaTime;
+    // Decrease velocity
+    outVelocity = velocity-drag*velocity*deltaTime;
+}
@@ -1,16 +1,26 @@
 #version 330
 
 //Uniform variables
-uniform mat4 P;
-uniform mat4 V;
 uniform mat4 M;
+uniform float interpolation; //how far the frame is between the last two simulation steps
+uniform float particleScale = 1; //level of detail size factor of the emitter
 
-//World space
-uniform vec4 lightSource=vec4(3.f, 6, 0.5f, 1);
+//Shared by all draws of the frame, see FrameUniforms
+layout (std140) uniform Frame {
+    mat4 P;
+    mat4 V;
+    mat4 VP;
+    vec4 cameraPosition;
+    vec4 lightPosition;
+    vec4 redLightSource;
+};
 
 //Attributes
 layout (location=0) in vec4 vertex; //vertex coordinates in model space
-layout (location=1) in vec4 normal; //vertex normal vector in model space
+layout (location=1) in vec2 normal; //vertex normal vector in model space, octahedral-encoded
+layout (location=3) in vec3 instancePosition; //particle position in world space, one per instance
+layout (location=4) in float instanceLifetime; //remaining lifetime, dead particles are <= 0
+layout (location=5) in vec3 instancePreviousPosition; //particle position one simulation step earlier
 
 
 //World space
@@ -18,10 +28,25 @@ out vec4 lightDir;
 out vec4 i_normal;
 out vec4 viewPosition;
 
+// Unfolds an octahedral-encoded unit vector
+vec3 decodeNormal(vec2 e) {
+    vec3 n = vec3(e, 1 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0);
+    n.xy += vec2(n.x >= 0 ? -t : t, n.y >= 0 ? -t : t);
+    return normalize(n);
+}
+
 void main(void) {
-    gl_Position=P*V*M*vertex;
+    if (instanceLifetime <= 0) {
+        //Outside of the clip volume, the whole instance is clipped
+        gl_Position = vec4(2, 2, 2, 1);
+        return;
+    }
+
+    vec4 worldPosition = M*vec4(vertex.xyz*particleScale, 1)+vec4(mix(instancePreviousPosition, instancePosition, interpolation), 0);
+    gl_Position=VP*worldPosition;
 
-    lightDir = lightSource-M*vertex;
-    i_normal = M*normal;
-    viewPosition = normalize(vec4(0,0,0,1)-V*M*vertex);
+    lightDir = redLightSource-worldPosition;
+    i_normal = M*vec4(decodeNormal(normal), 0);
+    viewPosition = normalize(vec4(0,0,0,1)-V*worldPosition);
 }
@@ -1,20 +1,36 @@
 #version 330
 
 //Uniform variables
-uniform mat4 P;
-uniform mat4 V;
-uniform mat4 M;
+uniform mat4 MV;
+uniform mat4 MVP;
 uniform vec4 lightColor = vec4(1);
-// World space
-uniform vec4 lightPosition = vec4(0, 1, 6, 1);
 uniform int phongExponent=30;
+// Height is waveAmplitude*sin(waveNumber*(x+z)+wavePhase) in model space
+uniform float wavePhase;
+uniform float waveNumber;
+uniform float waveAmplitude = 1;
+// Waves fade out between these distances from the camera, before coarse levels start to alias them
+uniform vec2 waveFade = vec2(150, 300);
+
+// Clipmap placement, see Ocean
+uniform float levelScale = 1;   // Cell size of the level
+uniform vec2 levelOffset;       // Model space XZ origin of the level
+uniform vec2 tileOffset;        // Tile position inside the level, in cells
+uniform float levelExtent = 1e9; // Half size of the level, in cells
+
+//Shared by all draws of the frame, see FrameUniforms
+layout (std140) uniform Frame {
+    mat4 P;
+    mat4 V;
+    mat4 VP;
+    vec4 cameraPosition;
+    vec4 lightPosition;
+    vec4 redLightSource;
+};
 
 //Attributes
-in vec4 vertex; //Vertex coordinates in model space
-in vec2 texCoord;
-// Model space
-in vec4 normals;
-in vec4 offset;
+layout (location=0) in vec4 vertex; //Vertex coordinates in model space
+layout (location=2) in vec2 texCoord;
 
 out vec2 texture_coordinate;
 out vec4 light;
@@ -23,13 +39,58 @@ out vec4 viewPosition;
 out vec4 f_lightColor;
 out float f_phongExponent;
 
+float amplitude(vec2 position) {
+    // Water is only moved up, so its model space XZ is the world one
+    return waveAmplitude*(1-smoothstep(waveFade.x, waveFade.y, distance(position, cameraPosition.xz)));
+}
+
+float height(vec2 position) {
+    return amplitude(position)*sin(waveNumber*(position.x+position.y)+wavePhase);
+}
+
+// Partial derivatives of height along x and z, including the fade of the amplitude
+vec2 gradient(vec2 position) {
+    float phase = waveNumber*(position.x+position.y)+wavePhase;
+    vec2 toCamera = position-cameraPosition.xz;
+    float d = max(length(toCamera), 1e-4);
+    float t = clamp((d-waveFade.x)/(waveFade.y-waveFade.x), 0, 1);
+    // Derivative of the smoothstep in amplitude(), along the direction away from the camera
+    vec2 fade = -waveAmplitude*6*t*(1-t)/(waveFade.y-waveFade.x)*toCamera/d;
+    return vec2(amplitude(position)*waveNumber*cos(phase))+fade*sin(phase);
+}
+
+vec3 normal(vec2 position) {
+    vec2 slope = gradient(position);
+    return normalize(vec3(-slope.x, 1, -slope.y));
+}
+
 void main(void) {
-    vec4 newPosition = vertex+offset;
-    gl_Position=P*V*M*newPosition;
+    vec2 cell = vertex.xz+tileOffset;
+    vec2 position = levelOffset+cell*levelScale;
+
+    float y = height(position);
+    vec3 n = normal(position);
+    // Odd vertices on the outer edge lie halfway along an edge of the coarser level,
+    // follow that edge exactly so there are no cracks between levels.
+    // The normal is interpolated the same way, so the shading matches the coarser level too.
+    vec2 edge = vec2(0);
+    if (abs(cell.x) == levelExtent && mod(cell.y, 2) != 0)
+        edge = vec2(0, levelScale);
+    else if (abs(cell.y) == levelExtent && mod(cell.x, 2) != 0)
+        edge = vec2(levelScale, 0);
+    if (edge != vec2(0)) {
+        y = 0.5*(height(position-edge)+height(position+edge));
+        n = normalize(normal(position-edge)+normal(position+edge));
+    }
+
+    vec4 newPosition = vec4(position.x, y, position.y, 1);
+    vec4 normals = vec4(n, 0);
+    gl_Position=MVP*newPosition;
     // Eye space
-    light = normalize(V*lightPosition - V*M*newPosition);
-    eyeNormal = normalize(V*M*normals);
-    viewPosition = normalize(vec4(0,0,0,1)-V*M*newPosition);
+    vec4 eyePosition = MV*newPosition;
+    light = normalize(V*lightPosition - eyePosition);
+    eyeNormal = normalize(MV*normals);
+    viewPosition = normalize(vec4(0,0,0,1)-eyePosition);
     // color = colors;
     f_lightColor = lightColor;
     f_phongExponent = phongExponent;